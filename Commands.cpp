@@ -6,25 +6,53 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <iomanip>
+#include <map>
+#include <algorithm>
+#include <errno.h>
+#include <limits.h>
 #include "Commands.h"
 #include "signals.h"
+#include "launcher.h"
+#include "copy.h"
+#include "reactor.h"
+#include "tokenizer.h"
+#include "status.h"
+#include "procstat.h"
 
 using namespace std;
 
 pid_t foregroundPid = 0;
 bool isForegroundPipe = false;
-pid_t pipeFirstCmdPid = NOT_FORKED;
-pid_t pipeSecondCmdPid = NOT_FORKED;
 bool isForegroundTimeout = false;
 pid_t timeoutInnerCmdPid = NOT_FORKED;
-pid_t nextAlarmedPid = NO_NEXT_ALARM;
-time_t nextEndingTime = NO_NEXT_ALARM;
-JobsList alarmList;
+int lastExitStatus = 0;
+TimerQueue timeouts;
+unsigned long directExecCount = 0;
+unsigned long bashExecCount = 0;
 
 string defPrompt = "smash";
 
 const std::string WHITESPACE = " \n\r\t\f\v";
 
+//chars that bash would expand or interpret, if a cmd has none of them
+// there is no need to start bash for it
+const char *SHELL_META_CHARS = "*?[]{}~$`'\"\\;&|<()!#";
+
+//bash keywords and builtins that have no program in PATH
+const char *BASH_ONLY_WORDS[] = {"if", "then", "for", "while", "until",
+                                 "case", "function", "select", "time", "[[",
+                                 "{", "!", "export", "source", ".", "alias",
+                                 "unalias", "set", "unset", "exec", "eval",
+                                 "ulimit", "umask", "read", "exit", "trap",
+                                 "wait", "type", "hash", "declare", "local",
+                                 "let", "shopt", NULL};
+
+//the cmds CreateCommand makes without running a program, for type
+const char *SMASH_BUILTINS[] = {"pwd", "chprompt", "showpid", "cd", "jobs",
+                                "kill", "fg", "bg", "quit", "stats", "cp",
+                                "hash", "type", "parallel", "sched",
+                                "lastjob", "jtop", "timeout", NULL};
+
 #if 0
 #define FUNC_ENTRY()  \
   cerr << __PRETTY_FUNCTION__ << " --> " << endl;
@@ -35,12 +63,11 @@ const std::string WHITESPACE = " \n\r\t\f\v";
 #define FUNC_ENTRY()
 #define FUNC_EXIT()
 #endif
-#define BUF_SIZE (4096)
 
 #define DEBUG_PRINT cerr << "DEBUG: "
 
-#define EXEC(path, arg) \
-  execvp((path), (arg));
+#define MIN_RATE_INTERVAL (0.5) // secs between cp rate samples
+
 
 
 string _ltrim(const std::string &s) {
@@ -57,58 +84,93 @@ string _trim(const std::string &s) {
     return _rtrim(_ltrim(s));
 }
 
-void setTimeoutCmdToNull(pid_t finishedPid) {
-    JobsList::JobEntry *toRemoveJob = alarmList.getJobByPid(finishedPid);
-    if (toRemoveJob == NULL) {
-        return;
-    }
-    toRemoveJob->setCommandToNull();
+//a whole number, may be negative
+static bool parseNumber(const char *str, long *number) {
+    char *end;
+    errno = 0;
+    *number = strtol(str, &end, 10);
+    return end != str && *end == '\0' && errno == 0 &&
+           *number >= INT_MIN && *number <= INT_MAX;
 }
 
-void removeTimeoutAndSetNewAlarm(pid_t finishedPid) {
-    JobsList::JobEntry *toRemoveJob = alarmList.getJobByPid(finishedPid);
-    if (toRemoveJob == NULL) {
-        return;
-    }
-    if (sigAlarmOn) {
-        if (toRemoveJob->getCommand() != NULL) { //print cmd only in case that smash terminated job because of alarm
-            if (waitpid(finishedPid, NULL, WNOHANG) != finishedPid) {
-                cout << "smash: " << toRemoveJob->getCommand()->getOrigCmd() << " timed out!" << endl;
-            } else {
-                toRemoveJob->getCommand()->setFinishedBeforeTimeoutTrue();
-            }
-        }
-        sigAlarmOn = false;
+//a % between 0 and 100, may be fractional
+static bool parsePercent(const char *str, double *percent) {
+    char *end;
+    errno = 0;
+    *percent = strtod(str, &end);
+    return end != str && *end == '\0' && errno == 0 && *percent >= 0 &&
+           *percent <= 100;
+}
+
+//a positive duration with an optional ms, s or m unit (s by default), may
+// be fractional
+static bool parseDuration(const char *str, long long *ns) {
+    char *end;
+    errno = 0;
+    double value = strtod(str, &end);
+    if (end == str || errno != 0 || !(value > 0)) {
+        return false;
     }
-    alarmList.removeJobById(toRemoveJob->getJobId());
-    JobsList::JobEntry *soonest = alarmList.getSoonestTimeoutEntry();
-    if (soonest != NULL) {
-        alarm(nextEndingTime - time(NULL));
-        nextAlarmedPid = soonest->getPid();
+    double unit;
+    if (strcmp(end, "") == 0 || strcmp(end, "s") == 0) {
+        unit = NS_PER_SEC;
+    } else if (strcmp(end, "ms") == 0) {
+        unit = NS_PER_SEC / 1000;
+    } else if (strcmp(end, "m") == 0) {
+        unit = NS_PER_SEC * 60;
     } else {
-        nextAlarmedPid = NO_NEXT_ALARM;
-        alarm(0); // cancel further alarms since there are no more timeout cmds
+        return false;
     }
+    if (value * unit >= 1e18) { // would overflow the deadline, or inf
+        return false;
+    }
+    *ns = (long long) (value * unit);
+    return *ns > 0;
+}
+
+//called before a timeout cmd is deleted, its timer must not fire anymore
+void cancelTimeout(pid_t finishedPid) {
+    long long next = timeouts.nextDeadline();
+    if (timeouts.cancel(finishedPid) && timeouts.nextDeadline() != next) {
+        armTimer(timeouts.nextDeadline());
+    }
+}
+
+//handles all the timeouts due by now together and arms the timer for the
+// next one
+void expireTimeouts() {
+    vector<Timer> due;
+    long long now = monotonicNs();
+    timeouts.popDue(now, due);
+    for (unsigned int i = 0; i < due.size(); i++) {
+        //print cmd only in case that smash terminates it. WNOWAIT leaves
+        // an exited timeout to the reaper of the jobs
+        siginfo_t info;
+        info.si_pid = 0;
+        waitid(P_PID, due[i].pid, &info, WEXITED | WNOHANG | WNOWAIT);
+        if (info.si_pid != due[i].pid) {
+            cout << "smash: " << due[i].cmd->getOrigCmd() << " timed out! ("
+                 << std::fixed << std::setprecision(3)
+                 << (now - due[i].deadline) / 1e6 << "ms late)" << endl;
+        }
+        kill(due[i].pid, SIGINT); //sending SIGINT so Timeout cmd will kill it's inner cmd and commit suicide
+        kill(due[i].pid, SIGCONT);
+    }
+    armTimer(timeouts.nextDeadline());
 }
 
 //function to handle foregrounded cmd which was interrupted by a signal
 // if NULL is sent as currJob that mean it was an external cmd in
-// foreground. in case of SIGSTP a new job will be added to job list in
+// foreground, and its cmd is deleted by the caller unless it became a job. in case of SIGSTP a new job will be added to job list in
 // the end of the list, else just update the JobEntry status
 void handleInterruptedCmd(pid_t pid, Command *cmd,
                           JobsList::JobEntry *currJob,
                           JobsList *jobsList) {
     if (sigINTOn) { // if FG process received ctrl+c
-        if (currJob == NULL) {
-            if (cmd->isTimeouted()) {
-                setTimeoutCmdToNull(pid);
-            }
-            delete cmd;
-        } else { //was foregrounded by fg
-            if (cmd->isTimeouted()) {
-                setTimeoutCmdToNull(pid);
-            }
-            delete cmd;
+        if (cmd->isTimeouted()) {
+            cancelTimeout(pid);
+        }
+        if (currJob != NULL) { //was foregrounded by fg, deletes cmd
             jobsList->removeJobById(currJob->getJobId());
         }
         sigINTOn = false;
@@ -121,7 +183,7 @@ void handleInterruptedCmd(pid_t pid, Command *cmd,
         if (currJob == NULL) { // wasn't foregrounded
             jobsList->addJob(cmd, pid, true);
         } else { // was foregrounded by fg command
-            currJob->setStatus(STOPPED);
+            jobsList->setJobStatus(currJob, STOPPED);
             currJob->setStartTimeNow();
         }
         sigSTPOn = false;
@@ -131,93 +193,33 @@ void handleInterruptedCmd(pid_t pid, Command *cmd,
     isForegroundTimeout = false;
 }
 
-void handleInterruptedCmdPipe(Command *cmd) {
-
-    if (sigINTOn) { // pipe should delete sons cmds
-        sigINTOn = false;
-        delete cmd;
-        kill(getpid(), SIGKILL); //pipe commit suicide
-    }
-
-    //no need to handle SIGTSTP, it is handled in the signal handler in signals.cpp
-}
-
-//converting the cmd string to cmd and options in the array args,
-// args[0] is the cmd.
-int _parseCommandLine(const char *cmd_line, char **args) {
-    FUNC_ENTRY()
-    int i = 0;
-    std::istringstream iss(_trim(string(cmd_line)).c_str());
-    for (std::string s; iss >> s;) {
-        if (s.find('>') != string::npos) { // split args with < included in them
-            string splittedArgs[3];
-            if (s.find(">>") != string::npos) { // args contain >>
-                int redirAppendPos = s.find(">>");
-                splittedArgs[0] = s.substr(0, redirAppendPos);
-                splittedArgs[1] = s.substr(redirAppendPos, 2);
-                splittedArgs[2] = s.substr(redirAppendPos + 2);
-            } else { // arg doesn't contain >>, so must contain only '>'
-                int redirPos = s.find('>');
-                splittedArgs[0] = s.substr(0, redirPos);
-                splittedArgs[1] = s.substr(redirPos, 1);
-                splittedArgs[2] = s.substr(redirPos + 1);
-            }
-            for (int j = 0; j < 3; j++) {
-                if (!(splittedArgs[j].empty())) {
-                    int length = splittedArgs[j].length();
-                    args[i] = (char *) malloc(length + 1);
-                    memset(args[i], 0, length + 1);
-                    strcpy(args[i], splittedArgs[j].c_str());
-                    args[++i] = NULL;
-
-                }
-            }
-        } else {
-            args[i] = (char *) malloc(s.length() + 1);
-            memset(args[i], 0, s.length() + 1);
-            strcpy(args[i], s.c_str());
-            args[++i] = NULL;
-        }
-    }
-    return i;
-
-    FUNC_EXIT()
-}
-
-string getFirstArg(const char *cmd_line) {
-    std::istringstream iss(_trim(string(cmd_line)).c_str());
-    string s;
-    iss >> s;
-    if (s.find('>') != string::npos) {
-        s = s.substr(0, s.find('>'));
-    }
-    if (s.find('&') == (s.size() - 1)) {
-        s.erase(s.size() - 1);
-    }
-    return s;
-}
-
 bool _isBackgroundComamnd(const char *cmd_line) {
     const string str(cmd_line);
     return str[str.find_last_not_of(WHITESPACE)] == '&';
 }
 
-void _removeBackgroundSign(char *cmd_line) {
-    const string str(cmd_line);
-    // find last character other than spaces
-    unsigned int idx = str.find_last_not_of(WHITESPACE);
-    // if all characters are spaces then return
-    if (idx == string::npos) {
-        return;
-    }
-    // if the command line does not end with & then return
-    if (cmd_line[idx] != '&') {
-        return;
+//splits a pipeline to its stages, links[i] is the type of the pipe from
+// stage i to the next one (PIPE or PIPE_ERR), the last link is NONE
+void splitPipeline(const char *cmd_line, vector<string> &stages,
+                   vector<IO_CHARS> &links) {
+    string line(cmd_line);
+    if (_isBackgroundComamnd(cmd_line)) {
+        line.erase(line.find_last_not_of(WHITESPACE));
+    }
+    size_t start = 0;
+    size_t pipeIndex;
+    while ((pipeIndex = line.find('|', start)) != string::npos) {
+        stages.push_back(line.substr(start, pipeIndex - start));
+        if (pipeIndex + 1 < line.size() && line[pipeIndex + 1] == '&') {
+            links.push_back(PIPE_ERR);
+            start = pipeIndex + 2;
+        } else {
+            links.push_back(PIPE);
+            start = pipeIndex + 1;
+        }
     }
-    // replace the & (background sign) with space and then remove all tailing spaces.
-    cmd_line[idx] = ' ';
-    // truncate the command line string up to the last non-space character
-    cmd_line[str.find_last_not_of(WHITESPACE, idx) + 1] = 0;
+    stages.push_back(line.substr(start));
+    links.push_back(NONE);
 }
 
 char *createExternCmd(char *const *args) {
@@ -233,6 +235,7 @@ char *createExternCmd(char *const *args) {
     }
     char *externCmdStr = (char *) malloc(externCmd.size() + 1);
     if (externCmdStr == NULL) {//allocation error
+        lastExitStatus = 1;
         cerr << "smash error: memory allocation failed" << endl;
         return NULL;
     }
@@ -244,6 +247,7 @@ char *createExternCmd(char *const *args) {
 char **createBashArgs(char *const *args) {
     char **bashArgs = (char **) malloc(4 * sizeof(char *));
     if (bashArgs == NULL) {
+        lastExitStatus = 1;
         cerr << "smash error: memory allocation failed" << endl;
         return NULL;
     }
@@ -257,6 +261,7 @@ char **createBashArgs(char *const *args) {
     if (bash == NULL) {
         free(bashArgs);
         free(externCmdStr);
+        lastExitStatus = 1;
         cerr << "smash error: memory allocation failed" << endl;
         return NULL;
     }
@@ -269,6 +274,7 @@ char **createBashArgs(char *const *args) {
         free(bashArgs);
         free(bash);
         free(externCmdStr);
+        lastExitStatus = 1;
         cerr << "smash error: memory allocation failed" << endl;
         return NULL;
     }
@@ -288,34 +294,28 @@ void freeBashArgs(char **bashArgs) {
         free(bashArgs[i]);
     }
     free(bashArgs);
-    *bashArgs = NULL;
 }
 
-void pipeManageFD(FDT_CHANNEL FDToCLose, int newFD, IO_CHARS pipeType) {
-    if (FDToCLose == IN) {
-        if (close(0) == -1) { // should close stdin
-            perror("smash error: close failed");
-            exit(0);
-        }
-    } else if (pipeType == PIPE) { //should close stdout
-        if (close(1) == -1) {
-            perror("smash error: close failed");
-            exit(0);
-        }
-    } else { // should close stderr
-        if (close(2) == -1) {
-            perror("smash error: close failed");
-            exit(0);
+bool needsShell(char *const *args) {
+    if (args[0] == NULL) {
+        return true;
+    }
+    for (int i = 0; BASH_ONLY_WORDS[i] != NULL; i++) {
+        if (strcmp(args[0], BASH_ONLY_WORDS[i]) == 0) {
+            return true;
         }
     }
-    if (dup(newFD) == -1) {
-        perror("smash error: dup failed");
-        exit(0);
+    if (strchr(args[0], '=') != NULL) { // variable assignment
+        return true;
     }
-    if (close(newFD) == -1) {
-        perror("smash error: close failed");
-        exit(0);
+    int i = 0;
+    while (args[i] != NULL && args[i][0] != '>') { // redirection is done by smash
+        if (strpbrk(args[i], SHELL_META_CHARS) != NULL) {
+            return true;
+        }
+        i++;
     }
+    return false;
 }
 
 bool isArgumentExist(char **args, const string &toFind) {
@@ -329,72 +329,46 @@ bool isArgumentExist(char **args, const string &toFind) {
     return false;
 }
 
-void cpMain(char *const *args) {
-    if (args[1] == NULL || args[2] == NULL) {
-        cerr << "smash error: cp: invalid arguments" << endl;
-        exit(0);
-    }
-    char buffer[BUF_SIZE] = "";
-    size_t buf_size = BUF_SIZE;
-    int fds[2];
-    ssize_t readSize, writeStatus = 1;
-    fds[0] = open(args[1], O_RDONLY);
-    if (fds[0] == -1) {
-        perror("smash error: open failed");
-        exit(0);
-    }
-    char *path1 = realpath(args[1], NULL);
-    char *path2 = realpath(args[2], NULL);
-    if (path2 != NULL && strcmp(path1, path2) == 0) {
-        cout << "smash: " << args[1] << " was copied to " << args[2] <<
-             endl;
-        free(path1);
-        free(path2);
-        exit(0);
-    }
-    free(path1);
-    free(path2);
-    fds[1] = open(args[2], O_WRONLY | O_CREAT | O_TRUNC, 0666);
-    if (fds[1] == -1) {
-        perror("smash error: open failed");
-        close(fds[0]);
-        exit(0);
-    }
-    while ((readSize = read(fds[0], buffer, buf_size)) > 0 && writeStatus > 0) {
-        if ((writeStatus = write(fds[1], buffer, readSize)) == -1) {
-            perror("smash error: write failed");
-            close(fds[0]);
-            close(fds[1]);
-            exit(0);
-        }
+//pipelines and parallel batches run in their own process group, so they
+// get the signal as a whole
+int signalCmd(const Command *cmd, pid_t pid, int sig) {
+    if (cmd->isGrouped()) {
+        return kill(-pid, sig);
     }
-    if (readSize == -1) {//read failed
-        perror("smash error: read failed");
-        close(fds[0]);
-        close(fds[1]);
-        exit(0);
-    }
-    close(fds[0]);
-    close(fds[1]);
-    cout << "smash: " << args[1] << " was copied to " << args[2] <<
-         endl;
-    exit(0);
+    return kill(pid, sig);
 }
+
 ///Command functions:
 
-Command::Command(const char *cmd_line) : isBackground(false),
-                                         origCmd(cmd_line), redirected
-                                                 (false), piped(false),
-                                         stdOutCopy(1), isTimeout(false), finishedBeforeTimeout(false) {
-    for (int i = 0; i < ARGS_AMOUNT; ++i) {
-        args[i] = NULL;
-    }
-    isBackground = _isBackgroundComamnd(cmd_line);
-    char without_amper[COMMAND_ARGS_MAX_LENGTH + 1];
-    strcpy(without_amper, cmd_line);
-    _removeBackgroundSign(without_amper);
-    argsNum = _parseCommandLine(without_amper, args);
-    if (strcmp(args[0], "timeout") == 0) {
+DEFINE_POOL(ChangeDirCommand)
+DEFINE_POOL(GetCurrDirCommand)
+DEFINE_POOL(ShowPidCommand)
+DEFINE_POOL(StatsCommand)
+DEFINE_POOL(ExternalCommand)
+DEFINE_POOL(PipeCommand)
+DEFINE_POOL(JobsCommand)
+DEFINE_POOL(KillCommand)
+DEFINE_POOL(ForegroundCommand)
+DEFINE_POOL(BackgroundCommand)
+DEFINE_POOL(CopyCommand)
+DEFINE_POOL(TimeoutCommand)
+DEFINE_POOL(ChangePrompt)
+DEFINE_POOL(QuitCommand)
+DEFINE_POOL(HashCommand)
+DEFINE_POOL(TypeCommand)
+DEFINE_POOL(ParallelCommand)
+DEFINE_POOL(LastJobCommand)
+DEFINE_POOL(JtopCommand)
+DEFINE_POOL(SchedCommand)
+
+Command::Command(const char *cmd_line, ParsedLine &&parsedLine) :
+        isBackground(false), origCmd(cmd_line), parsed(std::move(parsedLine)),
+        redirected(false), piped(false), stdOutCopy(1), isTimeout(false),
+        inJobs(false), grouped(false), usage(), reaped(false) {
+    isBackground = parsed.isBackground();
+    args = parsed.getArgs();
+    argsNum = parsed.getArgsNum();
+    if (args[0] != NULL && strcmp(args[0], "timeout") == 0) {
         isTimeout = true;
     }
     IO_CHARS receivedType = containsSpecialChars();
@@ -408,13 +382,13 @@ Command::Command(const char *cmd_line) : isBackground(false),
 }
 
 IO_CHARS Command::containsSpecialChars() const {
-    if (origCmd.find(">>") != string::npos) {
+    if (parsed.hasAppend()) {
         return REDIR_APPEND;
-    } else if (origCmd.find('>') != string::npos) {
+    } else if (parsed.hasRedirect()) {
         return REDIR;
-    } else if (origCmd.find("|&") != string::npos) {
+    } else if (parsed.hasPipeErr()) {
         return PIPE_ERR;
-    } else if (origCmd.find('|') != string::npos) {
+    } else if (parsed.hasPipe()) {
         return PIPE;
     }
     return NONE;
@@ -424,22 +398,27 @@ bool Command::setOutputFD(const char *path, IO_CHARS type) {
     if (type != REDIR && type != REDIR_APPEND) {
         return true;
     }
+    cout.flush(); // what smash wrote so far goes to the old stdout
     stdOutCopy = dup(1);
     if (stdOutCopy == -1) {
+        lastExitStatus = 1;
         perror("smash error: dup failed");
         return false;
     }
     if (close(1) == -1) {
+        lastExitStatus = 1;
         perror("smash error: close failed");
         return false;
     }
     if (type == REDIR) {
         if (open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666) == -1) {
+            lastExitStatus = 1;
             perror("smash error: open failed");
             return false;
         }
     } else { //must be REDIR_APPEND
         if (open(path, O_WRONLY | O_CREAT | O_APPEND, 0666) == -1) {
+            lastExitStatus = 1;
             perror("smash error: open failed");
             return false;
         }
@@ -447,10 +426,36 @@ bool Command::setOutputFD(const char *path, IO_CHARS type) {
     return true;
 }
 
+bool Command::addRedirection(LaunchSpec &spec) const {
+    bool opened = true;
+    if (type == REDIR) {
+        opened = spec.redirectFd(1, getPath(), O_WRONLY | O_CREAT | O_TRUNC);
+    } else if (type == REDIR_APPEND) {
+        opened = spec.redirectFd(1, getPath(), O_WRONLY | O_CREAT | O_APPEND);
+    }
+    if (!opened) {
+        lastExitStatus = 1;
+    }
+    return opened;
+}
+
+void Command::waitForeground(pid_t pid) {
+    int status;
+    struct rusage used;
+    if (reactorWait(pid, &status, WUNTRACED, &used) == pid) {
+        lastExitStatus = exitCode(status);
+        if (!WIFSTOPPED(status)) {
+            addUsage(usage, used);
+            reaped = true;
+        }
+    }
+}
+
 void Command::restoreStdOut() {
     if (stdOutCopy == -1) {
         return;
     }
+    cout.flush();
     close(1);
     dup2(stdOutCopy, 1);
     close(stdOutCopy);
@@ -471,6 +476,7 @@ void ShowPidCommand::execute() {
 void GetCurrDirCommand::execute() {
     char *currPath = get_current_dir_name();
     if (currPath == NULL) {
+        lastExitStatus = 1;
         perror("smash error: get_current_dir_name failed");
         return;
     }
@@ -481,26 +487,31 @@ void GetCurrDirCommand::execute() {
 void ChangeDirCommand::execute() {
     if (args[1] == NULL || args[1][0] == '>') return; //got only cd without path
     if (argsNum > 2 && args[2][0] != '>') {
+        lastExitStatus = 1;
         cerr << "smash error: cd: too many arguments" << endl;
         return;
     }
     if (strcmp(args[1], "-") == 0 && *lastPwd == NULL) {
+        lastExitStatus = 1;
         cerr << "smash error: cd: OLDPWD not set" << endl;
         return;
     }
     char *currPath = get_current_dir_name();
     if (currPath == NULL) {
+        lastExitStatus = 1;
         perror("smash error: get_current_dir_name failed");
         return;
     }
     if (strcmp(args[1], "-") == 0) { // to go back to last pwd
         if (chdir(*lastPwd) == -1) {
+            lastExitStatus = 1;
             perror("smash error: chdir failed");
             free(currPath);
             return;
         }
     } else { //if chdir arg is not "-"
         if (chdir(args[1]) == -1) {
+            lastExitStatus = 1;
             perror("smash error: chdir failed");
             free(currPath);
             return;
@@ -512,11 +523,45 @@ void ChangeDirCommand::execute() {
     *lastPwd = currPath;
 }
 
+//jobs -l lists the jobs that finished lately instead
 void JobsCommand::execute() {
     jobsList->removeFinishedJobs();
+    if (argsNum > 1 && strcmp(args[1], "-l") == 0) {
+        jobsList->printFinishedJobs();
+        return;
+    }
     jobsList->printJobsList();
 }
 
+void LastJobCommand::execute() {
+    jobsList->removeFinishedJobs();
+    if (jobsList->getFinished().empty()) {
+        lastExitStatus = 1;
+        cerr << "smash error: lastjob: no job finished yet" << endl;
+        return;
+    }
+    const JobsList::FinishedJob &last = jobsList->getFinished().back();
+    const struct rusage &usage = last.usage;
+    if (last.jobId == 0) {
+        cout << "[-] ";
+    } else {
+        cout << "[" << last.jobId << "] ";
+    }
+    std::streamsize precision = cout.precision(3);
+    cout << last.cmdLine << " : exit " << last.exitStatus << endl
+         << std::fixed << "wall " << last.wallNs / 1e9 << " secs, user "
+         << usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+         << " secs, sys "
+         << usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6 << " secs"
+         << endl << "max rss " << usage.ru_maxrss << " kB, faults "
+         << usage.ru_majflt << " major " << usage.ru_minflt << " minor, "
+         << "blocks " << usage.ru_inblock << " in " << usage.ru_oublock
+         << " out, switches " << usage.ru_nvcsw << " voluntary "
+         << usage.ru_nivcsw << " involuntary" << endl;
+    cout.unsetf(std::ios::floatfield);
+    cout.precision(precision);
+}
+
 void KillCommand::execute() {
     int sigNum = 0;
     int jobId = 0;
@@ -525,37 +570,50 @@ void KillCommand::execute() {
         jobId = stoi(args[2]);
     }
     catch (const std::exception &e) {
+        lastExitStatus = 1;
         cerr << "smash error: kill: invalid arguments" << endl;
         return;
     }
     if (args[1][0] != '-') {
+        lastExitStatus = 1;
         cerr << "smash error: kill: invalid arguments" << endl;
         return;
     }
     if (argsNum > 3 && args[3][0] != '>') {
+        lastExitStatus = 1;
         cerr << "smash error: kill: invalid arguments" << endl;
         return;
     }
     JobsList::JobEntry *toKill = jobsList->getJobById(jobId);
     if (toKill == NULL) {
+        lastExitStatus = 1;
         cerr << "smash error: kill: job-id " << jobId << " does not "
                                                          "exist" << endl;
         return;
     }
-    if (toKill->getCommand()->isPiped() || toKill->getCommand()->isTimeouted()) {
+    if (toKill->getStatus() == QUEUED) { // never started, just dropped
+        cout << "smash: job-id " << jobId << " was removed from the queue"
+             << endl;
+        jobsList->removeJobById(jobId);
+        return;
+    }
+    if (toKill->getCommand()->isTimeouted()) {
         if (sigNum == SIGKILL) {
             if (kill(toKill->getPid(), SIGINT) == -1) {
+                lastExitStatus = 1;
                 perror("smash error: kill failed");
                 return;
             }
         } else if (sigNum == SIGSTOP) {
             if (kill(toKill->getPid(), SIGTSTP) == -1) {
+                lastExitStatus = 1;
                 perror("smash error: kill failed");
                 return;
             }
         }
     } else {
-        if (kill(toKill->getPid(), sigNum) == -1) {
+        if (signalCmd(toKill->getCommand(), toKill->getPid(), sigNum) == -1) {
+            lastExitStatus = 1;
             perror("smash error: kill failed");
             return;
         }
@@ -569,6 +627,7 @@ void ForegroundCommand::execute() {
     pid_t toFGPid = 0;
     JobsList::JobEntry *toFG = NULL;
     if (argsNum > 2 && args[2][0] != '>' && args[1][0] != '>') {
+        lastExitStatus = 1;
         cerr << "smash error: fg: invalid arguments" << endl;
         return;
     }
@@ -577,49 +636,62 @@ void ForegroundCommand::execute() {
             jobId = stoi(args[1]);
         }
         catch (const std::exception &e) { // if jobId is not a number
+            lastExitStatus = 1;
             cerr << "smash error: fg: invalid arguments" << endl;
             return;
         }
         toFG = jobsList->getJobById(jobId);
         if (toFG == NULL) { // if requested jobId doesn't exist
+            lastExitStatus = 1;
             cerr << "smash error: fg: job-id " << jobId
                  << " does not exist"
                  << endl;
             return;
         }
     } else if ((argsNum == 1 || args[1][0] == '>') && jobsList->isJobListEmpty()) {
+        lastExitStatus = 1;
         cerr << "smash error: fg: jobs list is empty" << endl;
         return;
     } else {
         toFG = jobsList->getLastJob(&jobId);
     }
+    if (toFG->getStatus() == QUEUED) { // starts now, whatever the policy says
+        jobsList->startQueued(jobId);
+        toFG = jobsList->getJobById(jobId);
+        if (toFG == NULL) { // failed to start, printed
+            return;
+        }
+    }
     toFGPid = toFG->getPid();
-    cout << toFG->getCommand()->getOrigCmd() << " : " << toFGPid << endl;
+    cout << toFG->getCommand()->getOrigCmd() << " : " << toFGPid
+         << toFG->getCommand()->getProgress() << endl;
     Command *resumedCmd = toFG->getCommand();
-    if (kill(toFGPid, SIGCONT) == -1) {
+    if (signalCmd(resumedCmd, toFGPid, SIGCONT) == -1) {
+        lastExitStatus = 1;
         perror("smash error: kill failed");
         return;
     }
-    toFG->setStatus(RUNNING);
+    jobsList->setJobStatus(toFG, RUNNING);
     foregroundPid = toFGPid;
-    if (toFG->getCommand()->isPiped()) {
+    if (toFG->getCommand()->isGrouped()) {
         isForegroundPipe = true;
     }
     if (toFG->getCommand()->isTimeouted()) {
         isForegroundTimeout = true;
     }
-    waitpid(toFGPid, NULL, WUNTRACED);
+    resumedCmd->waitForeground(toFGPid);
+    toFG = jobsList->getJobById(jobId); // the table may have changed meanwhile
     if (sigINTOn || sigSTPOn) { //was interrupted by signal
         handleInterruptedCmd(toFGPid, resumedCmd, toFG, jobsList);
     } else { //process finished successfully in foreground
-        jobsList->removeJobById(jobId); // could also not remove and wait for removal in removeFinshedJobs
         if (isForegroundTimeout) {
-            setTimeoutCmdToNull(toFGPid);
+            cancelTimeout(toFGPid);
         }
-        delete resumedCmd;
+        jobsList->finishJob(jobId, lastExitStatus); // deletes resumedCmd
         foregroundPid = 0;
         isForegroundPipe = false;
         isForegroundTimeout = false;
+        jobsList->admitQueued(); // its wait reaped it, not the table
     }
 
 }
@@ -629,6 +701,7 @@ void BackgroundCommand::execute() {
     pid_t toBGPid = 0;
     JobsList::JobEntry *toBG = NULL;
     if (argsNum > 2 && args[2][0] != '>' && args[1][0] != '>') {
+        lastExitStatus = 1;
         cerr << "smash error: bg: invalid arguments" << endl;
         return;
     }
@@ -637,17 +710,29 @@ void BackgroundCommand::execute() {
             jobId = stoi(args[1]);
         }
         catch (const std::exception &e) { // if jobId is not a number
+            lastExitStatus = 1;
             cerr << "smash error: bg: invalid arguments" << endl;
             return;
         }
         toBG = jobsList->getJobById(jobId);
         if (toBG == NULL) { // if requested jobId doesn't exist
+            lastExitStatus = 1;
             cerr << "smash error: bg: job-id " << jobId
                  << " does not exist"
                  << endl;
             return;
         }
+        if (toBG->getStatus() == QUEUED) { // starts now, in the background
+            jobsList->startQueued(jobId);
+            toBG = jobsList->getJobById(jobId);
+            if (toBG != NULL) {
+                cout << toBG->getCommand()->getOrigCmd() << " : "
+                     << toBG->getPid() << endl;
+            }
+            return;
+        }
         if (toBG->getStatus() != STOPPED) {
+            lastExitStatus = 1;
             cerr << "smash error: bg: job-id " << jobId << " is already "
                                                            "running in "
                                                            "the background"
@@ -655,6 +740,7 @@ void BackgroundCommand::execute() {
             return;
         }
     } else if ((argsNum == 1 || args[1][0] == '>') && !(jobsList->stoppedJobExists())) {
+        lastExitStatus = 1;
         cerr << "smash error: bg: there is no stopped jobs to resume" <<
              endl;
         return;
@@ -663,15 +749,15 @@ void BackgroundCommand::execute() {
     }
     toBGPid = toBG->getPid();
     cout << toBG->getCommand()->getOrigCmd() << " : " << toBGPid << endl;
-    kill(toBGPid, SIGCONT);
-    toBG->setStatus(RUNNING);
+    signalCmd(toBG->getCommand(), toBGPid, SIGCONT);
+    jobsList->setJobStatus(toBG, RUNNING);
 }
 
 void QuitCommand::execute() {
     if (argsNum > 1) {
         if (isArgumentExist(args, "kill")) {//kill was specified
             jobsList->killAllJobs();
-            alarm(0);
+            armTimer(0);
         }
     }
     jobsList->destroyCmds();
@@ -679,191 +765,440 @@ void QuitCommand::execute() {
 }
 
 void ExternalCommand::execute() {
-    pid_t pid = fork();
+    LaunchSpec spec;
+    if (!addRedirection(spec)) {
+        return;
+    }
+    pid_t pid = launch(spec);
     if (pid == -1) {
-        perror("smash error: fork failed");
+        lastExitStatus = 1;
+        perror("smash error: posix_spawn failed");
         return;
     }
-    if (pid == 0) { // child process
-        char **bashArgs = createBashArgs(args);
-        if (bashArgs == NULL) exit(0); // allocation error, cannot execute external cmd
-        if (isRedirected()) {
-            if (!(setOutputFD(getPath(), type))) { //has to be ">" // or ">>"
-                exit(0);
-            }
+    if (isBackgroundCmd()) {//should not wait and add to jobsList
+        jobsList->addJob(this, pid);
+    } else {//should run in the foreground and wait for child to finish
+        foregroundPid = pid;
+        waitForeground(pid);
+        if (sigINTOn || sigSTPOn) { // was interrupted by signal
+            handleInterruptedCmd(pid, this, NULL, jobsList);
+        } else { // finished successfully
+            foregroundPid = 0;
         }
-        setpgrp();
-        execv("/bin/bash", bashArgs);
-        perror("smash error: execv failed");
-        freeBashArgs(bashArgs);
-        exit(0);
-    } else { // smash process
-        if (isBackgroundCmd()) {//should not wait and add to jobsList
-            jobsList->addJob(this, pid);
-        } else {//should run in the foreground and wait for child to finish
-            foregroundPid = pid;
-            waitpid(pid, NULL, WUNTRACED);
-            if (sigINTOn || sigSTPOn) { // was interrupted by signal
-                handleInterruptedCmd(pid, this, NULL, jobsList);
-            } else { // finished successfully
-                delete this;
-                foregroundPid = 0;
+    }
+}
+
+//launches the program directly from where the path cache found it if it
+// doesn't need shell semantics, and through bash otherwise (or if the
+// program wasn't found or isn't a binary, so bash will handle it)
+pid_t ExternalCommand::launch(const LaunchSpec &spec) {
+    if (directExec) {
+        vector<char *> argv;
+        for (int i = 0; args[i] != NULL && args[i][0] != '>'; i++) {
+            argv.push_back(args[i]);
+        }
+        argv.push_back(NULL);
+        string path;
+        if (paths->resolve(argv[0], path)) {
+            pid_t pid = launchProgram(spec, path.c_str(), argv.data(), false);
+            if (pid != -1) {
+                directExecCount++;
+                return pid;
+            }
+            if (errno != ENOENT && errno != ENOEXEC) {
+                return pid;
             }
+            paths->forget(argv[0]); // removed since it was found
         }
     }
+    char **bashArgs = createBashArgs(args);
+    if (bashArgs == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    pid_t pid = launchProgram(spec, bashArgs[0], bashArgs, false);
+    int spawnErrno = errno;
+    if (pid != -1) {
+        bashExecCount++; // also a direct exec that fell back
+    }
+    freeBashArgs(bashArgs);
+    errno = spawnErrno;
+    return pid;
 }
 
-void PipeCommand::execute() {
-    bool isFirstCmdExternal = dynamic_cast<ExternalCommand *>(firstCmd) == NULL ? false : true;
-    pid_t pipePid = fork();
-    if (pipePid == -1) {
-        perror("smash error: fork failed");
-        return;
-    } //fork pipe failed
-    if (pipePid == 0) {//Pipe process
-        setpgrp();
-        if (signal(SIGINT, pipeCtrlCHandler) == SIG_ERR) {
-            perror("smash error: failed to set pipe ctrl-C handler");
-            delete firstCmd;
-            delete secondCmd;
-            exit(0);
+void printLaunchCounter(const char *name, const LaunchCounter &counter) {
+    long long avgUs = counter.count == 0 ? 0 :
+                      counter.totalNs / (long long) counter.count / 1000;
+    cout << name << ": " << counter.count << " launched, " << counter.failed
+         << " failed, avg " << avgUs << " us, max " << counter.maxNs / 1000
+         << " us" << endl;
+}
+
+void StatsCommand::execute() {
+    cout << "exec: " << directExecCount << " direct, " << bashExecCount
+         << " via bash" << endl;
+    printLaunchCounter("spawn", spawnCounter);
+    printLaunchCounter("fork", forkCounter);
+    cout << "path cache: " << paths->getHits() << " hits, "
+         << paths->getMisses() << " misses, " << paths->getEntries().size()
+         << " entries" << endl;
+    cout << "JobEntry: " << jobsList->getJobsNum() << " live, "
+         << jobsList->getSlotsNum() << " slots" << endl;
+    for (const ObjectPool *pool = ObjectPool::first(); pool != NULL;
+         pool = pool->getNext()) {
+        if (pool->getPeak() == 0) {
+            continue; // never used
+        }
+        cout << pool->getName() << ": " << pool->getLive() << " live, "
+             << pool->getPeak() << " peak, " << pool->getCapacity()
+             << " slots" << endl;
+    }
+}
+
+void HashCommand::execute() {
+    if (argsNum == 1 || args[1][0] == '>') { // show the table, by name
+        const std::unordered_map<string, PathCache::Entry> &entries =
+                paths->getEntries();
+        std::map<string, const PathCache::Entry *> byName;
+        for (auto iter = entries.begin(); iter != entries.end(); ++iter) {
+            if (!iter->second.path.empty()) { // misses aren't shown
+                byName[iter->first] = &iter->second;
+            }
         }
-        if (signal(SIGTSTP, pipeCtrlZHandler) == SIG_ERR) {
-            perror("smash error: failed to set pipe ctrl-Z handler");
-            delete firstCmd;
-            delete secondCmd;
-            exit(0);
+        if (byName.empty()) {
+            cout << "smash: hash table empty" << endl;
+            return;
         }
-        if (signal(SIGCONT, pipeSigcontHandler) == SIG_ERR) {
-            perror("smash error: failed to set pipe SIGCONT handler");
-            delete firstCmd;
-            delete secondCmd;
-            exit(0);
+        cout << "hits\tcommand" << endl;
+        for (auto iter = byName.begin(); iter != byName.end(); ++iter) {
+            cout << std::setw(4) << iter->second->hits << "\t"
+                 << iter->second->path << endl;
         }
-        int myPipe[2];
-        pid_t sons[2] = {NOT_FORKED, NOT_FORKED};
-        if (pipe(myPipe) == -1) { //creating pipe failed
-            perror("smash error: pipe failed");
-            exit(0);
+        return;
+    }
+    if (strcmp(args[1], "-r") == 0) {
+        paths->reset();
+        return;
+    }
+    for (int i = 1; args[i] != NULL && args[i][0] != '>'; i++) { // prewarm
+        if (!paths->prewarm(args[i])) {
+            lastExitStatus = 1;
+            cerr << "smash error: hash: " << args[i] << ": not found" << endl;
         }
-        if (isFirstCmdExternal) {
-            sons[0] = fork();
-            if (sons[0] == -1) { //fork for firstCmd failed
-                perror("smash error: fork failed");
-                exit(0);
+    }
+}
+
+void TypeCommand::execute() {
+    for (int i = 1; args[i] != NULL && args[i][0] != '>'; i++) {
+        bool builtIn = false;
+        for (int j = 0; SMASH_BUILTINS[j] != NULL; j++) {
+            if (strcmp(args[i], SMASH_BUILTINS[j]) == 0) {
+                builtIn = true;
+                break;
             }
-            if (sons[0] == 0) {//firstCmd
-                setpgrp();
-                pipeManageFD(OUT, myPipe[1], type); //close stdout of forked firstCmd and dup pipe write to stdout
-                close(myPipe[0]);
-                if (!(((ExternalCommand *) firstCmd)->isCp())) { //firstCmd external
-                    char **firstBashArgs = createBashArgs(firstCmd->getArgs());
-                    if (firstBashArgs == NULL) exit(0);
-                    execv("/bin/bash", firstBashArgs);
-                    perror("smash error: execv failed");
-                    freeBashArgs(firstBashArgs);
-                    exit(0);
-                } else {//firstCmd is cp command
-                    cpMain(firstCmd->getArgs());
-                }
-            } else {//Pipe process
-                close(myPipe[1]); //pipe process should not be writer
-                // anymore
+        }
+        string path;
+        bool hashed;
+        if (builtIn) {
+            cout << args[i] << " is a smash builtin" << endl;
+        } else if (paths->locate(args[i], path, &hashed)) {
+            if (hashed) {
+                cout << args[i] << " is hashed (" << path << ")" << endl;
+            } else {
+                cout << args[i] << " is " << path << endl;
             }
+        } else {
+            lastExitStatus = 1;
+            cerr << "smash error: type: " << args[i] << ": not found" << endl;
         }
-        if (dynamic_cast<ExternalCommand *>(secondCmd) != NULL) {
-            sons[1] = fork();
-            if (sons[1] == -1) {
-                perror("smash error: fork failed");
-                exit(0);
+    }
+}
+
+//jtop [-d SECS] [-n COUNT], refreshes every SECS (1 by default), in place
+// on a terminal, until ctrl-C, COUNT refreshes or no job is left
+void JtopCommand::execute() {
+    long long delay = NS_PER_SEC;
+    long count = 0; // no limit
+    for (int i = 1; args[i] != NULL && args[i][0] != '>'; i += 2) {
+        if (args[i + 1] == NULL ||
+            !((strcmp(args[i], "-d") == 0 && parseDuration(args[i + 1], &delay)) ||
+              (strcmp(args[i], "-n") == 0 && parseNumber(args[i + 1], &count) &&
+               count > 0))) {
+            lastExitStatus = 1;
+            cerr << "smash error: jtop: invalid arguments" << endl;
+            return;
+        }
+    }
+    ProcSampler sampler; // its fds are kept open until jtop returns
+    bool inPlace = isatty(1);
+    int lines = 0;
+    for (long refresh = 1;; refresh++) {
+        jobsList->removeFinishedJobs();
+        jobsList->admitQueued();
+        std::ostringstream frame; // written at once, so it doesn't flicker
+        if (inPlace && lines > 0) { // back over the previous frame
+            frame << "\033[" << lines << "A\033[J";
+        } else if (lines > 0) {
+            frame << endl;
+        }
+        lines = jobsList->printJobsTop(sampler, frame);
+        cout << frame.str() << std::flush;
+        if (jobsList->isJobListEmpty() || refresh == count ||
+            !reactorPause(delay)) {
+            break;
+        }
+    }
+}
+
+//sched [-j N] [-cpu P] [-mem P] [-o fifo|priority] [-p PRIO JOBID], 0 turns
+// a limit off. without options shows the policy
+void SchedCommand::execute() {
+    AdmissionPolicy &policy = jobsList->getPolicy();
+    if (argsNum == 1 || args[1][0] == '>') {
+        cout << "max running: ";
+        if (policy.getMaxRunning() == NO_LIMIT) {
+            cout << "none";
+        } else {
+            cout << policy.getMaxRunning();
+        }
+        cout << " (" << jobsList->getRunningNum() << " running, "
+             << jobsList->getQueuedNum() << " queued)" << endl;
+        const char *resources[] = {"cpu", "memory"};
+        double limits[] = {policy.getCpuLimit(), policy.getMemoryLimit()};
+        for (int i = 0; i < 2; i++) {
+            double pressure = policy.pressure(resources[i]);
+            cout << resources[i] << " pressure: ";
+            if (pressure < 0) {
+                cout << "unsupported" << endl;
+                continue;
             }
-            if (sons[1] == 0) {//secondCmd
-                setpgrp();
-                pipeManageFD(IN, myPipe[0], type); //close unused copy of pipe read
-                if (!isFirstCmdExternal) {
-                    close(myPipe[1]);
-                }
-                if (!(((ExternalCommand *) secondCmd)->isCp())) { //secondCmd external
-                    char **secondBashArgs = createBashArgs(secondCmd->getArgs());
-                    if (secondBashArgs == NULL) exit(0);
-                    execv("/bin/bash", secondBashArgs);
-                    perror("smash error: execv failed");
-                    freeBashArgs(secondBashArgs);
-                    exit(0);
-                } else {//secondCmd is cp command
-                    cpMain(secondCmd->getArgs());
-                }
-            } else {//Pipe process
-                close(myPipe[0]);
+            cout << pressure << "%, limit: ";
+            if (limits[i] == NO_LIMIT) {
+                cout << "none" << endl;
+            } else {
+                cout << limits[i] << "%" << endl;
             }
         }
-        /*from here on, only pipe process remains - externals/cp will end
-        in their execv/copy stuff */
-        if (sons[0] == NOT_FORKED) { // firstCmd must be built-in cmd
-            int stdOutCopy = dup(1); //save a copy of stdOut
-            pipeManageFD(OUT, myPipe[1], type); // close stdOut of pipe process FDT and dup pipe write to stdout
-            firstCmd->execute();
-            pipeManageFD(OUT, stdOutCopy, type); // close pipe write and restore stdout in the FDT
-        }
-        if (sons[1] == NOT_FORKED) {// secondCmd must be built in
-            int stdInCopy = dup(0);
-            pipeManageFD(IN, myPipe[0], type);
-            secondCmd->execute();
-            pipeManageFD(IN, stdInCopy, type);
-        }
-        pipeFirstCmdPid = sons[0];
-        pipeSecondCmdPid = sons[1];
-        while (wait(NULL) != -1);
-        if (sigINTOn) {//wait was interrupted by SIGINT, won't get here if got SIGTSTP!
-            handleInterruptedCmdPipe(this);
-        } else {//sons finished successfully should finish pipe as well
-            delete this;
-            exit(0);
+        cout << "order: " << (policy.getOrder() == ORDER_FIFO ? "fifo" :
+                              "priority") << endl;
+        return;
+    }
+    for (int i = 1; args[i] != NULL && args[i][0] != '>'; i += 2) {
+        if (args[i + 1] == NULL) {
+            lastExitStatus = 1;
+            cerr << "smash error: sched: invalid arguments" << endl;
+            return;
         }
-    } else {//Smash process
-        if (isBackgroundCmd()) {//pipe runs in the background
-            jobsList->addJob(this, pipePid);
-        } else {//pipe runs in the foreground, wait for it and handle signals
-            isForegroundPipe = true;
-            foregroundPid = pipePid;
-            waitpid(pipePid, NULL, WUNTRACED);
-            if (sigINTOn || sigSTPOn) { // was interrupted by signal
-                handleInterruptedCmd(pipePid, this, NULL, jobsList);
-            } else { // finished successfully
-                delete this;
-                isForegroundPipe = false;
-                foregroundPid = 0;
+        long number;
+        double percent;
+        if (strcmp(args[i], "-j") == 0 && parseNumber(args[i + 1], &number) &&
+            number >= 0) {
+            policy.setMaxRunning(number);
+        } else if ((strcmp(args[i], "-cpu") == 0 ||
+                    strcmp(args[i], "-mem") == 0) &&
+                   parsePercent(args[i + 1], &percent)) {
+            bool supported = strcmp(args[i], "-cpu") == 0 ?
+                             policy.setCpuLimit(percent) :
+                             policy.setMemoryLimit(percent);
+            if (!supported) {
+                lastExitStatus = 1;
+                cerr << "smash error: sched: pressure is unsupported" << endl;
+                return;
             }
+        } else if (strcmp(args[i], "-o") == 0 &&
+                   strcmp(args[i + 1], "fifo") == 0) {
+            policy.setOrder(ORDER_FIFO);
+        } else if (strcmp(args[i], "-o") == 0 &&
+                   strcmp(args[i + 1], "priority") == 0) {
+            policy.setOrder(ORDER_PRIORITY);
+        } else if (strcmp(args[i], "-p") == 0 && args[i + 2] != NULL &&
+                   parseNumber(args[i + 1], &number)) {
+            long jobId;
+            if (!parseNumber(args[i + 2], &jobId) ||
+                !jobsList->setPriority(jobId, number)) {
+                lastExitStatus = 1;
+                cerr << "smash error: sched: job-id " << args[i + 2]
+                     << " is not queued" << endl;
+                return;
+            }
+            i++;
+        } else {
+            lastExitStatus = 1;
+            cerr << "smash error: sched: invalid arguments" << endl;
+            return;
         }
     }
+    jobsList->admitQueued(); // the new policy may admit more
 }
 
-void TimeoutCommand::execute() {
-    try {
-        duration = stoi(args[1]);
+void PipeCommand::addStage(Command *stage, IO_CHARS link) {
+    stages.push_back(stage);
+    links.push_back(link);
+}
+
+//launches one stage of the pipeline with the given spec, built-in stages
+// run in a forked child so they can write to the pipe like any other stage
+pid_t PipeCommand::launchStage(Command *stage, const LaunchSpec &spec) {
+    if (dynamic_cast<ExternalCommand *>(stage) != NULL) {
+        return ((ExternalCommand *) stage)->launch(spec);
     }
-    catch (const std::exception &e) {
-        cerr << "smash error: timeout: invalid arguments" << endl;
-        delete this;
+    pid_t pid = launchFork(spec);
+    if (pid == 0) { //built-in stage
+        stage->execute();
+        exit(0);
+    }
+    return pid;
+}
+
+//every stage is launched directly by smash into one process group (led by
+// the first stage), and smash waits on them itself
+void PipeCommand::execute() {
+    int prevRead = -1;
+    for (unsigned int i = 0; i < stages.size(); i++) {
+        int myPipe[2] = {-1, -1};
+        bool isLast = (i == stages.size() - 1);
+        if (!isLast && pipe(myPipe) == -1) {
+            lastExitStatus = 1;
+            perror("smash error: pipe failed");
+            break;
+        }
+        LaunchSpec spec;
+        spec.setGroup(pgid == NOT_FORKED ? NEW_PGRP : pgid);
+        if (prevRead != -1) { //previous pipe read becomes stdin
+            spec.dupFd(prevRead, 0);
+            spec.closeFd(prevRead);
+        }
+        if (!isLast) { //pipe write becomes stdout (or stderr for |&)
+            spec.dupFd(myPipe[1], links[i] == PIPE ? 1 : 2);
+            spec.closeFd(myPipe[1]);
+            spec.closeFd(myPipe[0]);
+        }
+        pid_t pid = -1;
+        if (stages[i]->addRedirection(spec)) {
+            pid = launchStage(stages[i], spec);
+            if (pid == -1) {
+                lastExitStatus = 1;
+                perror("smash error: launch failed");
+            }
+        }
+        if (prevRead != -1) {
+            close(prevRead);
+        }
+        if (!isLast) {
+            close(myPipe[1]);
+        }
+        prevRead = myPipe[0];
+        if (pid == -1) {
+            break;
+        }
+        if (pgid == NOT_FORKED) {
+            pgid = pid;
+        }
+        stagePids.push_back(pid);
+        aliveStages++;
+    }
+    if (prevRead != -1) {
+        close(prevRead);
+    }
+    if (stagePids.size() != stages.size()) { //launching a stage failed
+        if (pgid != NOT_FORKED) {
+            kill(-pgid, SIGKILL);
+            waitForeground(pgid);
+        }
         return;
     }
-    if (duration <= 0) {
+    lastStagePid = stagePids.back();
+    if (isBackgroundCmd()) {//pipe runs in the background
+        jobsList->addJob(this, pgid);
+    } else {//pipe runs in the foreground, wait for it and handle signals
+        isForegroundPipe = true;
+        foregroundPid = pgid;
+        waitForeground(pgid);
+        if (sigINTOn || sigSTPOn) { // was interrupted by signal
+            handleInterruptedCmd(pgid, this, NULL, jobsList);
+        } else { // finished successfully
+            isForegroundPipe = false;
+            foregroundPid = 0;
+        }
+    }
+}
+
+//waits until all stages finish, or until the pipeline was stopped by ctrl-Z.
+// stop reports of stages that were already continued are skipped
+void PipeCommand::waitForeground(pid_t pid) {
+    int status = 0;
+    while (aliveStages > 0) {
+        struct rusage used;
+        pid_t res = reactorWait(-pid, &status, WUNTRACED, &used);
+        if (res == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            aliveStages = 0; //no stages left to wait for
+            break;
+        }
+        if (WIFSTOPPED(status)) {
+            if (sigSTPOn) {
+                lastExitStatus = exitCode(status);
+                return;
+            }
+            continue;
+        }
+        if (res == lastStagePid) { // the status of a pipe is its last stage's
+            lastExitStatus = exitCode(status);
+        }
+        addUsage(usage, used);
+        reaped = true;
+        stageExited(res);
+    }
+}
+
+void PipeCommand::stageExited(pid_t pid) {
+    for (unsigned int i = 0; i < stagePids.size(); i++) {
+        if (stagePids[i] == pid) {
+            stagePids[i] = NOT_FORKED;
+            aliveStages--;
+            return;
+        }
+    }
+}
+
+std::vector<pid_t> PipeCommand::getChildPids(pid_t pid) const {
+    std::vector<pid_t> alive;
+    for (unsigned int i = 0; i < stagePids.size(); i++) {
+        if (stagePids[i] != NOT_FORKED) {
+            alive.push_back(stagePids[i]);
+        }
+    }
+    return alive;
+}
+
+bool PipeCommand::childExited(pid_t pid) {
+    stageExited(pid);
+    return aliveStages == 0;
+}
+
+void TimeoutCommand::execute() {
+    if (!parseDuration(args[1], &duration)) {
+        lastExitStatus = 1;
         cerr << "smash error: timeout: invalid arguments" << endl;
-        delete this;
         return;
     }
-    endingTime = time(NULL) + duration;
+    deadline = monotonicNs() + duration;
     if (dynamic_cast<BuiltInCommand *>(innerCmd) != NULL) {
         innerCmd->execute();
     }
-    pid_t timeoutPid = fork();
+    LaunchSpec timeoutSpec;
+    if (!addRedirection(timeoutSpec)) {
+        return;
+    }
+    pid_t timeoutPid = launchFork(timeoutSpec);
+    if (timeoutPid == -1) {
+        lastExitStatus = 1;
+        perror("smash error: fork failed");
+        return;
+    }
     if (timeoutPid == 0) { //timeout process
-        if (isRedirected()) {
-            if (!setOutputFD(getPath(), type)) {
-                exit(0);
-            }
-        }
-        setpgrp();
         if (signal(SIGINT, timeoutCtrlCHandler) == SIG_ERR) {
             perror("smash error: failed to set pipe ctrl-C handler");
             delete innerCmd;
@@ -881,48 +1216,33 @@ void TimeoutCommand::execute() {
         }
         pid_t innerCmdPid = NOT_FORKED;
         if (dynamic_cast<ExternalCommand *>(innerCmd) != NULL) {
-            innerCmdPid = fork();
+            LaunchSpec innerSpec;
+            innerCmdPid = ((ExternalCommand *) innerCmd)->launch(innerSpec);
             if (innerCmdPid == -1) {
-                perror("smash error: fork failed");
+                perror("smash error: launch failed");
                 exit(0);
             }
-            if (innerCmdPid == 0) {//innerCmd
-                setpgrp();
-                if (!(((ExternalCommand *) innerCmd)->isCp())) { //innerCmd external
-                    char **innerBashArgs = createBashArgs(innerCmd->getArgs());
-                    if (innerBashArgs == NULL) exit(0);
-                    execv("/bin/bash", innerBashArgs);
-                    perror("smash error: execv failed");
-                    freeBashArgs(innerBashArgs);
-                    exit(0);
-                } else {//innerCmd is cp command
-                    cpMain(innerCmd->getArgs());
-                }
-            }
         }
         timeoutInnerCmdPid = innerCmdPid;
-        wait(NULL);
-        delete this; //deleting timeoutCMD from timeout memory space
-        kill(getpid(), SIGKILL);
+        int status = 0; // stays 0 for a built-in, it already ran in smash
+        wait(&status);
+        _exit(exitCode(status)); // the status of the inner cmd
     } else { //smash process
-        alarmList.addJob(this, timeoutPid);
-        if (nextEndingTime == NO_NEXT_ALARM || nextEndingTime > endingTime) { //no previous alarm exists
-            // or previous alarm is later
-            alarm(duration);
-            nextAlarmedPid = timeoutPid;
-            nextEndingTime = endingTime;
+        long long next = timeouts.nextDeadline();
+        timeouts.add(timeoutPid, deadline, this);
+        if (timeouts.nextDeadline() != next) { //the earliest timeout
+            armTimer(timeouts.nextDeadline());
         }
         if (isBackgroundCmd()) {//timeout runs in the background
             jobsList->addJob(this, timeoutPid);
         } else {//timeout runs in the foreground, wait for it and handle signals
             isForegroundTimeout = true;
             foregroundPid = timeoutPid;
-            waitpid(timeoutPid, NULL, WUNTRACED);
+            waitForeground(timeoutPid);
             if (sigINTOn || sigSTPOn) { // was interrupted by signal
                 handleInterruptedCmd(timeoutPid, this, NULL, jobsList);
             } else { // finished successfully or because of timeout or because inner command finished
-                setTimeoutCmdToNull(timeoutPid);
-                delete this;
+                cancelTimeout(timeoutPid);
                 isForegroundTimeout = false;
                 foregroundPid = 0;
             }
@@ -930,179 +1250,494 @@ void TimeoutCommand::execute() {
     }
 }
 
-void CopyCommand::execute() {
-    pid_t cpPid = fork();
+pid_t CopyCommand::launch(const LaunchSpec &spec) {
+    clock_gettime(CLOCK_MONOTONIC, &lastSample);
+    pid_t cpPid = launchFork(spec);
     if (cpPid == 0) { //cp process
-        setpgrp();
-        if (isRedirected()) {
-            if (!(setOutputFD(getPath(), type))) { //has to be ">" // or ">>"
-                exit(0);
-            }
-        }
-        cpMain(args);
-    } else {//smash process
-        if (isBackgroundCmd()) {//should not wait and add to jobsList
-            jobsList->addJob(this, cpPid);
-        } else {//should run in the foreground and wait for child to finish
-            foregroundPid = cpPid;
-            waitpid(cpPid, NULL, WUNTRACED);
-            if (sigINTOn || sigSTPOn) { // was interrupted by signal
-                handleInterruptedCmd(cpPid, this, NULL, jobsList);
-            } else { // finished successfully
-                delete this;
-                foregroundPid = 0;
-            }
+        cpMain(args, isBackgroundCmd(), progress);
+    }
+    return cpPid;
+}
+
+string CopyCommand::getProgress() {
+    if (progress == NULL) {
+        return "";
+    }
+    uint64_t total = progress->total.load(std::memory_order_relaxed);
+    uint64_t copied = progress->copied.load(std::memory_order_relaxed);
+    if (total == 0) {
+        return "";
+    }
+    if (copied > total) { // the source grew while it was copied
+        copied = total;
+    }
+    //the rate since the previous look, the first look is since the launch
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double interval = (now.tv_sec - lastSample.tv_sec) +
+                      (now.tv_nsec - lastSample.tv_nsec) / 1e9;
+    if (interval >= MIN_RATE_INTERVAL) {
+        rate = (copied - lastCopied) / interval;
+        lastCopied = copied;
+        lastSample = now;
+    }
+    std::ostringstream out;
+    out << " " << copied * 100 / total << "% " << std::fixed
+        << std::setprecision(1) << rate / (1 << 20) << " MB/s";
+    if (rate > 0 && copied < total) {
+        out << " ETA " << (long) ((total - copied) / rate) << " secs";
+    }
+    return out.str();
+}
+
+void CopyCommand::execute() {
+    LaunchSpec spec;
+    if (!addRedirection(spec)) {
+        return;
+    }
+    pid_t cpPid = launch(spec);
+    if (cpPid == -1) {
+        lastExitStatus = 1;
+        perror("smash error: fork failed");
+        return;
+    }
+    if (isBackgroundCmd()) {//should not wait and add to jobsList
+        jobsList->addJob(this, cpPid);
+    } else {//should run in the foreground and wait for child to finish
+        foregroundPid = cpPid;
+        waitForeground(cpPid);
+        if (sigINTOn || sigSTPOn) { // was interrupted by signal
+            handleInterruptedCmd(cpPid, this, NULL, jobsList);
+        } else { // finished successfully
+            foregroundPid = 0;
         }
     }
+}
 
+pid_t ParallelCommand::launch(const LaunchSpec &spec) {
+    pid_t supervisorPid = launchFork(spec); // leads its own process group
+    if (supervisorPid == 0) { //supervisor process
+        parallelMain(options, paths, progress);
+    }
+    return supervisorPid;
+}
+
+string ParallelCommand::getProgress() {
+    if (progress == NULL) {
+        return "";
+    }
+    std::ostringstream out;
+    out << " " << progress->done.load() << " done, "
+        << progress->running.load() << " running, "
+        << progress->failed.load() << " failed";
+    return out.str();
+}
+
+void ParallelCommand::execute() {
+    if (!parseParallelArgs(args, options)) {
+        lastExitStatus = 1;
+        cerr << "smash error: parallel: invalid arguments" << endl;
+        return;
+    }
+    if (progress == NULL) {
+        lastExitStatus = 1; // mmap failed, printed
+        return;
+    }
+    LaunchSpec spec;
+    if (!addRedirection(spec)) {
+        return;
+    }
+    pid_t supervisorPid = launch(spec);
+    if (supervisorPid == -1) {
+        lastExitStatus = 1;
+        perror("smash error: fork failed");
+        return;
+    }
+    if (isBackgroundCmd()) {//one job for the whole batch
+        jobsList->addJob(this, supervisorPid);
+    } else {//the batch runs in the foreground, signals go to all of it
+        isForegroundPipe = true;
+        foregroundPid = supervisorPid;
+        waitForeground(supervisorPid);
+        if (sigINTOn || sigSTPOn) { // was interrupted by signal
+            handleInterruptedCmd(supervisorPid, this, NULL, jobsList);
+        } else { // finished successfully
+            isForegroundPipe = false;
+            foregroundPid = 0;
+        }
+    }
 }
 
 ///Jobs list functions:
 
-JobsList::JobsList() : maxId(0), jobsList() {
+JobsList::JobsList() : maxId(0), jobsList(), slotByPid(), slotById(1, NO_SLOT),
+                       stoppedHead(NO_SLOT), stoppedTail(NO_SLOT),
+                       runningJobs(0), queue(), admittingId(0), policy() {
 }
 
-JobsList::JobEntry *JobsList::getJobById(int jobId) {
-    for (auto iter = jobsList.begin(); iter != jobsList.end();
-         ++iter) {
-        if (iter->getJobId() == jobId) {
-            return &(*iter);
+//the stopped list is kept in jobId order. a job is usually stopped right
+// after it was added, so the walk from the tail stops at once
+void JobsList::linkStopped(int slot) {
+    JobEntry &entry = jobsList[slot];
+    int prev = stoppedTail;
+    while (prev != NO_SLOT && jobsList[prev].jobId > entry.jobId) {
+        prev = jobsList[prev].prevStopped;
+    }
+    int next = prev == NO_SLOT ? stoppedHead : jobsList[prev].nextStopped;
+    entry.prevStopped = prev;
+    entry.nextStopped = next;
+    if (prev == NO_SLOT) {
+        stoppedHead = slot;
+    } else {
+        jobsList[prev].nextStopped = slot;
+    }
+    if (next == NO_SLOT) {
+        stoppedTail = slot;
+    } else {
+        jobsList[next].prevStopped = slot;
+    }
+}
+
+void JobsList::unlinkStopped(int slot) {
+    JobEntry &entry = jobsList[slot];
+    if (entry.prevStopped == NO_SLOT) {
+        stoppedHead = entry.nextStopped;
+    } else {
+        jobsList[entry.prevStopped].nextStopped = entry.nextStopped;
+    }
+    if (entry.nextStopped == NO_SLOT) {
+        stoppedTail = entry.prevStopped;
+    } else {
+        jobsList[entry.nextStopped].prevStopped = entry.prevStopped;
+    }
+    entry.prevStopped = NO_SLOT;
+    entry.nextStopped = NO_SLOT;
+}
+
+void JobsList::moveEntry(int from, int to) {
+    JobEntry &entry = jobsList[from];
+    if (entry.status == STOPPED) {
+        if (entry.prevStopped == NO_SLOT) {
+            stoppedHead = to;
+        } else {
+            jobsList[entry.prevStopped].nextStopped = to;
+        }
+        if (entry.nextStopped == NO_SLOT) {
+            stoppedTail = to;
+        } else {
+            jobsList[entry.nextStopped].prevStopped = to;
         }
     }
-    return NULL;
+    if (entry.status != QUEUED) {
+        slotByPid[entry.pid] = to;
+    }
+    slotById[entry.jobId] = to;
+    jobsList[to] = entry;
 }
 
-JobsList::JobEntry *JobsList::getLastJob(int *lastJobId) {
-    if (jobsList.empty()) {
-        *lastJobId = 0;
+void JobsList::removeSlot(int slot) {
+    JobEntry &entry = jobsList[slot];
+    if (entry.status == STOPPED) {
+        unlinkStopped(slot);
+    } else if (entry.status == RUNNING) {
+        runningJobs--;
+    }
+    if (entry.status == QUEUED) {
+        auto queued = std::find(queue.begin(), queue.end(), entry.jobId);
+        if (queued != queue.end()) {
+            queue.erase(queued);
+        }
+    } else {
+        slotByPid.erase(entry.pid);
+        jobIdByChild.erase(entry.pid);
+        std::vector<pid_t> children = entry.cmd->getChildPids(entry.pid);
+        for (unsigned int i = 0; i < children.size(); i++) {
+            jobIdByChild.erase(children[i]);
+        }
+    }
+    slotById[entry.jobId] = NO_SLOT;
+    Command *cmd = entry.cmd;
+    int last = jobsList.size() - 1;
+    if (slot != last) {
+        moveEntry(last, slot);
+    }
+    jobsList.pop_back();
+    //the ids above the highest one in use are dropped, each only once
+    while (maxId > 0 && slotById[maxId] == NO_SLOT) {
+        maxId--;
+    }
+    slotById.resize(maxId + 1);
+    delete cmd;
+}
+
+JobsList::JobEntry *JobsList::getJobById(int jobId) {
+    if (jobId <= 0 || jobId > maxId || slotById[jobId] == NO_SLOT) {
         return NULL;
     }
-    *lastJobId = jobsList.back().getJobId();
-    return &(jobsList.back());
-    // reference to the last object and we want to return the address to it
+    return &jobsList[slotById[jobId]];
+}
+
+JobsList::JobEntry *JobsList::getLastJob(int *lastJobId) {
+    *lastJobId = maxId;
+    return getJobById(maxId);
 }
 
 void JobsList::printJobsList() {
-    for (auto iter = jobsList.begin(); iter != jobsList.end();
-         ++iter) {
-        time_t currTime = time(NULL);
-        if (currTime == (time_t) (-1)) {
-            perror("smash error: time failed");
-            return;
+    time_t currTime = time(NULL);
+    if (currTime == (time_t) (-1)) {
+        perror("smash error: time failed");
+        return;
+    }
+    for (int jobId = 1; jobId <= maxId; jobId++) {
+        if (slotById[jobId] == NO_SLOT) {
+            continue;
         }
-        int elapsedTime = difftime(currTime, iter->getStartTime());
-        cout << "[" << iter->getJobId() << "] " <<
-             iter->getCommand()->getOrigCmd() << " : " <<
-             iter->getPid() << " " << elapsedTime << " secs";
-        if (iter->getStatus() == STOPPED) {
+        JobEntry &entry = jobsList[slotById[jobId]];
+        int elapsedTime = difftime(currTime, entry.getStartTime());
+        if (entry.getStatus() == QUEUED) {
+            cout << "[" << entry.getJobId() << "] "
+                 << entry.getCommand()->getOrigCmd() << " : " << elapsedTime
+                 << " secs (queued)" << endl;
+            continue;
+        }
+        cout << "[" << entry.getJobId() << "] " <<
+             entry.getCommand()->getOrigCmd() << " : " <<
+             entry.getPid() << " " << elapsedTime << " secs" <<
+             entry.getCommand()->getProgress();
+        if (entry.getStatus() == STOPPED) {
             cout << " (stopped)";
         }
         cout << endl;
     }
 }
 
-void JobsList::removeJobById(int jobId) {
-    for (auto iter = jobsList.begin(); iter != jobsList.end();
-         ++iter) {
-        if (iter->getJobId() == jobId) {
-            jobsList.remove(*iter);
-            if (jobsList.empty()) {
-                maxId = 0;
-            }
-            maxId = jobsList.back().getJobId();
-            return;
+int JobsList::printJobsTop(ProcSampler &sampler, ostream &out) {
+    std::streamsize precision = out.precision(1);
+    out << std::fixed << std::left << std::setw(8) << "JOB" << std::right
+        << std::setw(8) << "PID" << " S" << std::setw(8) << "CPU%"
+        << std::setw(10) << "RSS kB" << std::setw(10) << "READ kB/s"
+        << std::setw(11) << "WRITE kB/s" << "  CMD" << endl;
+    int lines = 1;
+    sampler.beginSweep();
+    std::vector<pid_t> pids;
+    std::vector<ProcSample> samples;
+    for (int jobId = 1; jobId <= maxId; jobId++) {
+        if (slotById[jobId] == NO_SLOT) {
+            continue;
         }
+        JobEntry &entry = jobsList[slotById[jobId]];
+        std::ostringstream id;
+        id << "[" << jobId << "]";
+        if (entry.status == QUEUED) {
+            out << std::left << std::setw(8) << id.str() << std::right
+                << std::setw(8) << "-" << " Q" << std::setw(39) << "" << "  "
+                << entry.cmd->getOrigCmd() << " (queued)" << endl;
+            lines++;
+            continue;
+        }
+        //the stages, then the children of every process found so far
+        pids = entry.cmd->getChildPids(entry.pid);
+        samples.clear();
+        for (unsigned int i = 0; i < pids.size(); i++) {
+            ProcSample sample;
+            if (!sampler.sample(pids[i], sample)) { // exited, not reaped yet
+                pids.erase(pids.begin() + i--);
+                continue;
+            }
+            samples.push_back(sample);
+            sampler.children(pids[i], pids);
+        }
+        ProcSample total = {samples.empty() ? 'Z' : samples[0].state,
+                            0, 0, 0, 0};
+        for (unsigned int i = 0; i < samples.size(); i++) {
+            total.cpu += samples[i].cpu;
+            total.rssKb += samples[i].rssKb;
+            total.readKbps += samples[i].readKbps;
+            total.writeKbps += samples[i].writeKbps;
+        }
+        out << std::left << std::setw(8) << id.str() << std::right
+            << std::setw(8) << entry.pid << " " << total.state << std::setw(8)
+            << total.cpu << std::setw(10) << total.rssKb << std::setw(10)
+            << total.readKbps << std::setw(11) << total.writeKbps << "  "
+            << entry.cmd->getOrigCmd() << endl;
+        lines++;
+        for (unsigned int i = 0; samples.size() > 1 && i < samples.size(); i++) {
+            out << std::setw(16) << pids[i] << " " << samples[i].state
+                << std::setw(8) << samples[i].cpu << std::setw(10)
+                << samples[i].rssKb << std::setw(10) << samples[i].readKbps
+                << std::setw(11) << samples[i].writeKbps << endl;
+            lines++;
+        }
+    }
+    sampler.endSweep();
+    out.unsetf(std::ios::floatfield);
+    out.precision(precision);
+    return lines;
+}
+
+void JobsList::removeJobById(int jobId) {
+    if (getJobById(jobId) != NULL) {
+        removeSlot(slotById[jobId]);
     }
 }
 
-JobsList::JobEntry *JobsList::getJobByPid(pid_t pid) {
-    for (auto iter = jobsList.begin(); iter != jobsList.end();
-         ++iter) {
-        if (iter->getPid() == pid) {
-            return &(*iter);
+void JobsList::recordFinished(int jobId, const Command *cmd, int exitStatus,
+                              long long wallNs, const struct rusage &usage) {
+    if (finished.size() == FINISHED_HISTORY) {
+        finished.pop_front();
+    }
+    FinishedJob job = {jobId, cmd->getOrigCmd(), exitStatus, wallNs, usage};
+    finished.push_back(job);
+}
+
+void JobsList::finishJob(int jobId, int exitStatus) {
+    JobEntry *entry = getJobById(jobId);
+    if (entry == NULL) {
+        return;
+    }
+    struct rusage usage = entry->usage;
+    addUsage(usage, entry->cmd->getUsage()); // what it used in the foreground
+    recordFinished(jobId, entry->cmd, exitStatus, monotonicNs() - entry->startNs,
+                   usage);
+    removeSlot(slotById[jobId]);
+}
+
+void JobsList::recordForeground(const Command *cmd, int exitStatus,
+                                long long wallNs) {
+    recordFinished(0, cmd, exitStatus, wallNs, cmd->getUsage());
+}
+
+void JobsList::printFinishedJobs() const {
+    std::streamsize precision = cout.precision(3);
+    cout << std::fixed;
+    for (auto iter = finished.begin(); iter != finished.end(); ++iter) {
+        const struct rusage &usage = iter->usage;
+        if (iter->jobId == 0) {
+            cout << "[-] ";
+        } else {
+            cout << "[" << iter->jobId << "] ";
         }
+        cout << iter->cmdLine << " : exit " << iter->exitStatus << ", "
+             << iter->wallNs / 1e9 << " wall "
+             << usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+             << " user "
+             << usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6
+             << " sys secs, " << usage.ru_maxrss << " kB max rss" << endl;
     }
-    return NULL;
+    cout.unsetf(std::ios::floatfield);
+    cout.precision(precision);
 }
 
-JobsList::JobEntry *JobsList::getSoonestTimeoutEntry() {
-    if (jobsList.empty()) {
-        nextEndingTime = NO_NEXT_ALARM;
-        nextAlarmedPid = NO_NEXT_ALARM;
+JobsList::JobEntry *JobsList::getJobByPid(pid_t pid) {
+    auto slot = slotByPid.find(pid);
+    if (slot == slotByPid.end()) {
         return NULL;
     }
-    JobsList::JobEntry *soonestEntry = &(*jobsList.begin());
-    TimeoutCommand *soonestTimeout = (TimeoutCommand *) ((jobsList.begin())->getCommand());
-    time_t minEndingTime = soonestTimeout->getEndingTime();
-    for (auto iter = jobsList.begin(); iter != jobsList.end();
-         ++iter) {
-        TimeoutCommand *currentTimeout = (TimeoutCommand *) (iter->getCommand());
-        if (currentTimeout->getEndingTime() < minEndingTime) {
-            minEndingTime = currentTimeout->getEndingTime();
-            soonestEntry = &(*iter);
-        }
+    return &jobsList[slot->second];
+}
+
+void JobsList::setJobStatus(JobEntry *entry, STATUS status) {
+    if (entry->status == status) {
+        return;
+    }
+    int slot = entry - jobsList.data();
+    if (entry->status == STOPPED) {
+        unlinkStopped(slot);
+    } else if (entry->status == RUNNING) {
+        runningJobs--;
+    }
+    entry->status = status;
+    if (status == STOPPED) {
+        linkStopped(slot);
+    } else if (status == RUNNING) {
+        runningJobs++;
     }
-    nextEndingTime = minEndingTime;
-    return soonestEntry;
 }
 
 bool JobsList::stoppedJobExists() const {
-    for (auto iter = jobsList.begin();
-         iter != jobsList.end(); ++iter) {
-        if (iter->getStatus() == STOPPED) {
-            return true;
-        }
-    }
-    return false;
+    return stoppedHead != NO_SLOT;
 }
 
 JobsList::JobEntry *JobsList::getLastStoppedJob(int *jobId) {
-    JobsList::JobEntry *maxStoppedJob = NULL;
-    for (auto iter = jobsList.begin(); iter != jobsList.end();
-         ++iter) {
-        if (iter->getStatus() == STOPPED) {
-            maxStoppedJob = &(*iter);
-        }
-    }
-    if (maxStoppedJob != NULL) {
-        *jobId = maxStoppedJob->getJobId();
+    if (stoppedTail == NO_SLOT) {
+        return NULL;
     }
-    return maxStoppedJob;
+    *jobId = jobsList[stoppedTail].getJobId();
+    return &jobsList[stoppedTail];
 }
 
+//wait4 is only called when SIGCHLD was received, and then only for the
+// children that changed state. while a foreground cmd is waited for, only
+// the processes of the other jobs are waited for, one by one, so its
+// status is left to its wait
 void JobsList::removeFinishedJobs() {
-    if (jobsList.empty()) return;
-    auto iter = jobsList.begin();
-    while (iter != jobsList.end()) {
-        if (waitpid(iter->getPid(), NULL, WNOHANG) == iter->getPid()
-            || iter->getCommand()->isFinishedBeforeTimeout()) {
-            if (iter->getCommand()->isTimeouted()) {
-                setTimeoutCmdToNull(iter->getPid());
-            }
-            auto toDelete = iter++;
-            delete toDelete->getCommand();
-            jobsList.remove(*toDelete);
-            continue;
+    if (!takeChildEvents()) {
+        return;
+    }
+    int status;
+    pid_t pid;
+    struct rusage used;
+    pid_t waited = waitedChild();
+    JobEntry *waitedJob = waited == 0 ? NULL :
+                          getJobByPid(waited < 0 ? -waited : waited);
+    int waitedId = waitedJob == NULL ? 0 : waitedJob->jobId; // after fg
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED,
+                        &used)) > 0) {
+        auto child = jobIdByChild.find(pid);
+        bool isJob = child != jobIdByChild.end() && child->second != waitedId;
+        if (waited != 0 && !isJob) { // the waited cmd's, for its wait
+            stashWaited(pid, status, used);
+        } else {
+            childChanged(pid, status, used);
         }
-        ++iter;
     }
-    getLastJob(&maxId); //updates maxId to the last job jobId
+}
+
+void JobsList::childChanged(pid_t pid, int status, const struct rusage &used) {
+    auto child = jobIdByChild.find(pid);
+    if (child == jobIdByChild.end()) {
+        return; // not a job, its cmd was already deleted
+    }
+    JobEntry *entry = getJobById(child->second);
+    if (entry == NULL) {
+        jobIdByChild.erase(child);
+        return;
+    }
+    if (WIFSTOPPED(status)) {
+        setJobStatus(entry, STOPPED);
+    } else if (WIFCONTINUED(status)) {
+        setJobStatus(entry, RUNNING);
+    } else {
+        jobIdByChild.erase(child);
+        Command *cmd = entry->getCommand();
+        addUsage(entry->usage, used);
+        if (pid == cmd->getStatusPid(entry->getPid())) { // a pipe's last stage
+            entry->exitStatus = exitCode(status);
+        }
+        if (!cmd->childExited(pid)) {
+            return; // other stages of the pipe are still running
+        }
+        if (cmd->isTimeouted()) {
+            cancelTimeout(entry->getPid());
+        }
+        finishJob(entry->getJobId(), entry->exitStatus);
+    }
 }
 
 void JobsList::killAllJobs() {
-    cout << "smash: sending SIGKILL signal to " << jobsList.size()
-         << " jobs:" << endl;
-    for (auto iter = jobsList.begin(); iter != jobsList.end();
-         ++iter) {
-        pid_t currPid = iter->getPid();
+    cout << "smash: sending SIGKILL signal to "
+         << jobsList.size() - queue.size() << " jobs:" << endl;
+    for (int jobId = 1; jobId <= maxId; jobId++) {
+        if (slotById[jobId] == NO_SLOT ||
+            jobsList[slotById[jobId]].status == QUEUED) { // nothing to kill
+            continue;
+        }
+        JobEntry &entry = jobsList[slotById[jobId]];
+        pid_t currPid = entry.getPid();
         cout << currPid << ": " <<
-             iter->getCommand()->getOrigCmd() << endl;
-        if (iter->getCommand()->isPiped()) {
-            if (kill(currPid, SIGINT) == -1) {
-                perror("smash error: kill failed");
-                return;
-            }
-        } else if (kill(currPid, SIGKILL) == -1) {
+             entry.getCommand()->getOrigCmd() << endl;
+        if (signalCmd(entry.getCommand(), currPid, SIGKILL) == -1) {
+            lastExitStatus = 1;
             perror("smash error: kill failed");
             return;
         }
@@ -1111,93 +1746,215 @@ void JobsList::killAllJobs() {
 }
 
 void JobsList::destroyCmds() {
-    for (auto iter = jobsList.begin(); iter != jobsList.end();
-         ++iter) {
-        delete iter->getCommand(); // should delete all cmds generated
-        // and entered to the jobsList (shouldn't be other cmds);
+    while (!jobsList.empty()) {
+        removeSlot(jobsList.size() - 1);
     }
 }
 
+//smash reaps the finished jobs before every cmd, so maxId is already the
+// highest id in use
 void JobsList::addJob(Command *cmd, pid_t pid, bool isStopped) {
-    removeFinishedJobs();
     STATUS status = isStopped ? STOPPED : RUNNING;
-    JobEntry toAdd(++maxId, pid, cmd, status);
-    jobsList.push_back(toAdd);
+    int slot;
+    if (admittingId != 0) { // a queued job that started, it keeps its entry
+        slot = slotById[admittingId];
+        jobsList[slot].pid = pid;
+        jobsList[slot].setStartTimeNow();
+    } else {
+        slot = jobsList.size();
+        jobsList.push_back(JobEntry(++maxId, pid, cmd, QUEUED));
+        cmd->inJobs = true;
+        slotById.push_back(slot);
+    }
+    int jobId = jobsList[slot].jobId;
+    slotByPid[pid] = slot;
+    std::vector<pid_t> children = cmd->getChildPids(pid);
+    for (unsigned int i = 0; i < children.size(); i++) {
+        jobIdByChild[children[i]] = jobId;
+    }
+    setJobStatus(&jobsList[slot], status);
+    //what was reaped for its foreground wait and not taken, like the exit
+    // of a stage after another one stopped
+    int childStatus;
+    struct rusage used;
+    pid_t child;
+    while ((child = takeStashed(pid, WUNTRACED | WCONTINUED, &childStatus,
+                                &used)) > 0 ||
+           (child = takeStashed(-pid, WUNTRACED | WCONTINUED, &childStatus,
+                                &used)) > 0) {
+        childChanged(child, childStatus, used);
+    }
+}
+
+bool JobsList::admits() {
+    return queue.empty() && policy.admits(runningJobs);
+}
+
+void JobsList::holdQueue() {
+    armRetry(!queue.empty() && policy.heldByPressure() ? SCHED_RETRY_NS : 0);
+}
+
+void JobsList::queueJob(Command *cmd) {
+    int slot = jobsList.size();
+    jobsList.push_back(JobEntry(++maxId, 0, cmd, QUEUED));
+    cmd->inJobs = true;
+    slotById.push_back(slot);
+    queue.push_back(maxId);
+    holdQueue();
+}
+
+int JobsList::nextQueued() const {
+    if (policy.getOrder() == ORDER_FIFO) {
+        return queue.front();
+    }
+    int next = queue.front(); // the first of the highest priority
+    for (auto iter = queue.begin(); iter != queue.end(); ++iter) {
+        if (jobsList[slotById[*iter]].priority >
+            jobsList[slotById[next]].priority) {
+            next = *iter;
+        }
+    }
+    return next;
+}
+
+void JobsList::admitQueued() {
+    while (!queue.empty()) {
+        if (!policy.admits(runningJobs)) {
+            break;
+        }
+        startQueued(nextQueued());
+    }
+    holdQueue();
+}
+
+void JobsList::startQueued(int jobId) {
+    auto queued = std::find(queue.begin(), queue.end(), jobId);
+    if (queued != queue.end()) {
+        queue.erase(queued);
+    }
+    admittingId = jobId;
+    jobsList[slotById[jobId]].cmd->execute(); // a background cmd, it calls addJob
+    admittingId = 0;
+    JobEntry *entry = getJobById(jobId);
+    if (entry != NULL && entry->status == QUEUED) { // failed, printed
+        removeSlot(slotById[jobId]);
+    }
+}
+
+bool JobsList::setPriority(int jobId, int priority) {
+    JobEntry *entry = getJobById(jobId);
+    if (entry == NULL || entry->status != QUEUED) {
+        return false;
+    }
+    entry->priority = priority;
+    return true;
 }
 
 ///Smash functions:
 
 SmallShell::SmallShell() : prompt(defPrompt), lastPwd(NULL),
-                           jobsList(), toQuit(false) {
+                           jobsList(), pathCache(), toQuit(false) {
 }
 
 SmallShell::~SmallShell() {
     free(lastPwd);
 }
 
+//the line is parsed once, the cmd takes the parse. NULL for an empty line
 Command *SmallShell::CreateCommand(const char *cmd_line) {
-    string cmd_s = string(cmd_line);
-    string cmd_trimmed = _trim(cmd_s);
-    string cmdOnly = getFirstArg(cmd_line);
-
-    //find return The position of the first character of the first match
     try {
-        if (cmd_trimmed.find('|') != string::npos) {
-            return new PipeCommand(cmd_line, &jobsList);
+        ParsedLine parsed(cmd_line);
+        if (parsed.getArgsNum() == 0) {
+            return NULL;
+        }
+        string cmdOnly = parsed.getArgs()[0];
+        if (parsed.hasPipe()) {
+            return new PipeCommand(cmd_line, std::move(parsed), &jobsList);
         }
         if (cmdOnly == "pwd") {
-            return new GetCurrDirCommand(cmd_line);
+            return new GetCurrDirCommand(cmd_line, std::move(parsed));
         }
         if (cmdOnly == "chprompt") {
-            return new ChangePrompt(cmd_line, this);
+            return new ChangePrompt(cmd_line, std::move(parsed), this);
         }
         if (cmdOnly == "showpid") {
-            return new ShowPidCommand(cmd_line, getpid());
+            return new ShowPidCommand(cmd_line, std::move(parsed), getpid());
         }
         if (cmdOnly == "cd") {
-            return new ChangeDirCommand(cmd_line, &lastPwd);
+            return new ChangeDirCommand(cmd_line, std::move(parsed), &lastPwd);
         }
         if (cmdOnly == "jobs") {
-            return new JobsCommand(cmd_line, &jobsList);
+            return new JobsCommand(cmd_line, std::move(parsed), &jobsList);
+        }
+        if (cmdOnly == "lastjob") {
+            return new LastJobCommand(cmd_line, std::move(parsed), &jobsList);
+        }
+        if (cmdOnly == "jtop") {
+            return new JtopCommand(cmd_line, std::move(parsed), &jobsList);
         }
         if (cmdOnly == "kill") {
-            return new KillCommand(cmd_line, &jobsList);
+            return new KillCommand(cmd_line, std::move(parsed), &jobsList);
         }
         if (cmdOnly == "fg") {
-            return new ForegroundCommand(cmd_line, &jobsList);
+            return new ForegroundCommand(cmd_line, std::move(parsed), &jobsList);
         }
         if (cmdOnly == "bg") {
-            return new BackgroundCommand(cmd_line, &jobsList);
+            return new BackgroundCommand(cmd_line, std::move(parsed), &jobsList);
         }
         if (cmdOnly == "quit") {
-            return new QuitCommand(cmd_line, &jobsList, this);
+            return new QuitCommand(cmd_line, std::move(parsed), &jobsList, this);
+        }
+        if (cmdOnly == "stats") {
+            return new StatsCommand(cmd_line, std::move(parsed), &jobsList, &pathCache);
         }
         if (cmdOnly == "cp") {
-            return new CopyCommand(cmd_line, &jobsList);
+            return new CopyCommand(cmd_line, std::move(parsed), &jobsList);
+        }
+        if (cmdOnly == "hash") {
+            return new HashCommand(cmd_line, std::move(parsed), &pathCache);
+        }
+        if (cmdOnly == "type") {
+            return new TypeCommand(cmd_line, std::move(parsed), &pathCache);
+        }
+        if (cmdOnly == "parallel") {
+            return new ParallelCommand(cmd_line, std::move(parsed), &jobsList,
+                                       &pathCache);
+        }
+        if (cmdOnly == "sched") {
+            return new SchedCommand(cmd_line, std::move(parsed), &jobsList);
         }
         if (cmdOnly == "timeout") {
-            return new TimeoutCommand(cmd_line, &jobsList);
+            return new TimeoutCommand(cmd_line, std::move(parsed), &jobsList);
         } else { // External Cmds
-            return new ExternalCommand(cmd_line, &jobsList);
+            return new ExternalCommand(cmd_line, std::move(parsed), &jobsList,
+                                       &pathCache);
         }
     }
     catch (const std::exception &e) {
+        lastExitStatus = 1;
         cerr << "smash error: memory allocation failed" << endl;
         return NULL;
     }
 }
 
+//lastExitStatus is 0 unless the cmd ran in the foreground and failed, or
+// it failed in smash (every error path sets it)
 void SmallShell::executeCommand(const char *cmd_line) {
+    lastExitStatus = 0;
+    runCommand(cmd_line);
+}
+
+void SmallShell::runCommand(const char *cmd_line) {
     bool isBuiltIn = false, redirectedSuccess = true;
-    if (_trim(cmd_line).empty()) { //no cmd received, go get next cmd
-        return;
-    }
     Command *cmd = CreateCommand(cmd_line);
-    if (cmd == NULL) return; //allocation failed, wait for next command
+    if (cmd == NULL) return; //empty, or allocation failed. wait for next command
+    long long startNs = monotonicNs();
     jobsList.removeFinishedJobs();
+    jobsList.admitQueued();
     IO_CHARS cmdIOType = cmd->getType();
     if (cmd->isTimeouted()) {
         if (cmd->getArgsNum() <= 2) {
+            lastExitStatus = 1;
             cerr << "smash error: timeout: invalid arguments" << endl;
             delete cmd;
             return;
@@ -1208,22 +1965,19 @@ void SmallShell::executeCommand(const char *cmd_line) {
         ((TimeoutCommand *) (cmd))->setInnerCmd( //converting to TimeoutCommand
                 // to access setCmd member function
                 CreateCommand(innerCmd.c_str()));
-    } else if (cmd->isPiped()) { //prepare sub cmds of the pipe
-        string stringCmd = (string) (cmd_line);
-        unsigned long pipeIndex = stringCmd.find('|');
-        string firstCmd = stringCmd.substr(0, pipeIndex);
-        string secondCmd;
-        if (cmdIOType == PIPE) {
-            // second cmd , is it really pipeIndex + 1?
-            secondCmd = stringCmd.substr(pipeIndex + 1);
-        } else {//must be PIPE_ERR
-            secondCmd = stringCmd.substr(pipeIndex + 2);
-        }
-        ((PipeCommand *) (cmd))->setFirstCmd( //converting to PipeCommand
-                // to access setCmds member functions
-                CreateCommand(firstCmd.c_str()));
-        ((PipeCommand *) (cmd))->setSecondCmd(
-                CreateCommand(secondCmd.c_str()));
+    } else if (cmd->isPiped()) { //prepare the stages of the pipe
+        vector<string> stageLines;
+        vector<IO_CHARS> links;
+        splitPipeline(cmd_line, stageLines, links);
+        for (unsigned int i = 0; i < stageLines.size(); i++) {
+            Command *stage = CreateCommand(stageLines[i].c_str());
+            if (stage == NULL) {
+                delete cmd;
+                return;
+            }
+            ((PipeCommand *) (cmd))->addStage(stage, links[i]); //converting to PipeCommand
+            // to access addStage member function
+        }
     }
     if (dynamic_cast<BuiltInCommand *>(cmd) != NULL) {
         isBuiltIn = true;
@@ -1239,12 +1993,18 @@ void SmallShell::executeCommand(const char *cmd_line) {
             // if redirected cmd and was redirect successfully
             cmd->execute();
         }
+    } else if (cmd->isBackgroundCmd() && !jobsList.admits()) {
+        jobsList.queueJob(cmd); // executed once the policy admits it
     } else { //not built in so execute anyhow
         cmd->execute();
     }
-    if (isBuiltIn) {
-        if (cmd->isRedirected()) { //restore stdout to channel 1 in FDT
-            cmd->restoreStdOut();
+    if (isBuiltIn && cmd->isRedirected()) { //restore stdout to channel 1 in FDT
+        cmd->restoreStdOut();
+    }
+    if (!cmd->isJob()) {
+        if (cmd->wasReaped()) { // it ran processes to the end
+            jobsList.recordForeground(cmd, lastExitStatus,
+                                      monotonicNs() - startNs);
         }
         delete cmd;
     }
@@ -2,69 +2,82 @@
 #define SMASH_COMMAND_H_
 
 #include <vector>
-#include <list>
+#include <unordered_map>
+#include <deque>
+#include <utility>
 #include <cstring>
 #include <fstream>
 #include <unistd.h>
+#include <sys/resource.h>
+#include "launcher.h"
+#include "copy.h"
+#include "timers.h"
+#include "tokenizer.h"
+#include "pool.h"
+#include "pathcache.h"
+#include "parallel.h"
+#include "admission.h"
 
 using std::ostream;
 
-#define COMMAND_ARGS_MAX_LENGTH (200)
-#define COMMAND_MAX_ARGS (20)
 #define NOT_FORKED (-2)
-#define NO_NEXT_ALARM (-2)
-#define ARGS_AMOUNT (25)
+#define NO_SLOT (-1)
+#define FINISHED_HISTORY (10) // finished jobs kept for jobs -l
 
 using std::string;
-using std::list;
 
 extern bool sigSTPOn;
 extern bool sigINTOn;
-extern bool sigAlarmOn;
 extern pid_t foregroundPid;
-extern bool isForegroundPipe;
+extern bool isForegroundPipe; // the foreground cmd is grouped, see isGrouped
 extern string defPrompt;
-extern pid_t pipeFirstCmdPid;
-extern pid_t pipeSecondCmdPid;
 extern bool isForegroundTimeout;
 extern pid_t timeoutInnerCmdPid;
-extern time_t nextEndingTime;
+extern int lastExitStatus; // of the last cmd, like $? in bash
+extern unsigned long directExecCount; // launches smash made itself
+extern unsigned long bashExecCount;
+
+bool needsShell(char *const *args);
 
 
 typedef enum {
-    RUNNING, STOPPED
+    RUNNING, STOPPED, QUEUED // QUEUED jobs wait for admission, no pid yet
 } STATUS;
 typedef enum {
     REDIR, REDIR_APPEND, PIPE, PIPE_ERR, NONE
 } IO_CHARS;
-typedef enum {
-    IN, OUT
-} FDT_CHANNEL;
+
+class JobsList;
+
+class ProcSampler;
 
 class Command {
 protected:
     bool isBackground;
     string origCmd;
-    char *args[ARGS_AMOUNT];
+    ParsedLine parsed;
+    char **args; // into parsed, NULL terminated
     int argsNum;
     bool redirected;
     bool piped;
     IO_CHARS type;
     int stdOutCopy;
     bool isTimeout;
-    bool finishedBeforeTimeout;
+    bool inJobs; // owned by the job table from addJob on
+    bool grouped; // runs in its own process group, signalled as a whole
+    struct rusage usage; // of the processes it waited for in the foreground
+    bool reaped; // one of them exited
+
+    friend class JobsList;
 public:
-    explicit Command(const char *cmd_line);
-
-    virtual ~Command() {
-        for (int i = 0; i < ARGS_AMOUNT; i++) {
-            if (args[i] != NULL) {
-                free(args[i]);
-            } else {
-                break;
-            }
-        }
-    }
+    //takes the line parsed by the caller, which saw its first arg already
+    Command(const char *cmd_line, ParsedLine &&parsed);
+
+    explicit Command(const char *cmd_line) :
+            Command(cmd_line, ParsedLine(cmd_line)) {
+    };
+
+    virtual ~Command() = default;
 
     string getOrigCmd() const {
         return origCmd;
@@ -76,10 +89,45 @@ public:
 
     virtual void execute() = 0;
 
+    //waits for the cmd running in the foreground to finish or stop
+    virtual void waitForeground(pid_t pid);
+
+    //the processes a job of the cmd waits for, pid is the one it was
+    // added with
+    virtual std::vector<pid_t> getChildPids(pid_t pid) const {
+        return std::vector<pid_t>(1, pid);
+    }
+
+    //called when one of them was reaped, returns true if the cmd finished
+    virtual bool childExited(pid_t pid) {
+        return true;
+    }
+
+    //the process whose exit status is the cmd's
+    virtual pid_t getStatusPid(pid_t pid) const {
+        return pid;
+    }
+
+    //how far the running cmd got, appended to its line in jobs and fg
+    virtual string getProgress() {
+        return "";
+    }
+
+    const struct rusage &getUsage() const {
+        return usage;
+    }
+
+    bool wasReaped() const {
+        return reaped;
+    }
+
     IO_CHARS containsSpecialChars() const;
 
     bool setOutputFD(const char *path, IO_CHARS type);
 
+    //redirects stdout of a launched child if the cmd is redirected
+    bool addRedirection(LaunchSpec &spec) const;
+
     bool isRedirected() const {
         return redirected;
     }
@@ -109,38 +157,42 @@ public:
         return piped;
     }
 
+    bool isGrouped() const {
+        return grouped;
+    }
+
     void restoreStdOut();
 
     bool isTimeouted() const {
         return isTimeout;
     }
 
-    char *const *getArgs() const {
-        return args;
+    //false if whoever created the cmd should delete it after execute
+    bool isJob() const {
+        return inJobs;
     }
 
-    void setFinishedBeforeTimeoutTrue() {
-        finishedBeforeTimeout = true;
-    }
-
-    bool isFinishedBeforeTimeout() const {
-        return finishedBeforeTimeout;
+    char *const *getArgs() const {
+        return args;
     }
 };
 
 class BuiltInCommand : public Command {
 public:
-    explicit BuiltInCommand(const char *cmd_line) : Command(cmd_line) {
+    BuiltInCommand(const char *cmd_line, ParsedLine &&parsed) :
+            Command(cmd_line, std::move(parsed)) {
     };
 
     virtual ~BuiltInCommand() = default;
 };
 
 class ChangeDirCommand : public BuiltInCommand {
+    POOLED
     char **lastPwd;
 public:
-    ChangeDirCommand(const char *cmd_line, char **plastPwd) :
-            BuiltInCommand(cmd_line), lastPwd(plastPwd) {
+    ChangeDirCommand(const char *cmd_line, ParsedLine &&parsed,
+                     char **plastPwd) :
+            BuiltInCommand(cmd_line, std::move(parsed)), lastPwd(plastPwd) {
     };
 
     virtual ~ChangeDirCommand() = default;
@@ -149,9 +201,10 @@ public:
 };
 
 class GetCurrDirCommand : public BuiltInCommand {
+    POOLED
 public:
-    explicit GetCurrDirCommand(const char *cmd_line) : BuiltInCommand(
-            cmd_line) {
+    GetCurrDirCommand(const char *cmd_line, ParsedLine &&parsed) :
+            BuiltInCommand(cmd_line, std::move(parsed)) {
     };
 
     virtual ~GetCurrDirCommand() = default;
@@ -160,10 +213,11 @@ public:
 };
 
 class ShowPidCommand : public BuiltInCommand {
+    POOLED
     pid_t smashPid;
 public:
-    ShowPidCommand(const char *cmd_line, pid_t smashPid) : BuiltInCommand(
-            cmd_line), smashPid(smashPid) {
+    ShowPidCommand(const char *cmd_line, ParsedLine &&parsed, pid_t smashPid) :
+            BuiltInCommand(cmd_line, std::move(parsed)), smashPid(smashPid) {
     };
 
     virtual ~ShowPidCommand() = default;
@@ -171,6 +225,22 @@ public:
     void execute() override;
 };
 
+class StatsCommand : public BuiltInCommand {
+    POOLED
+    JobsList *jobsList;
+    PathCache *paths;
+public:
+    StatsCommand(const char *cmd_line, ParsedLine &&parsed, JobsList *jobsList,
+                 PathCache *paths) :
+            BuiltInCommand(cmd_line, std::move(parsed)), jobsList(jobsList),
+            paths(paths) {
+    };
+
+    virtual ~StatsCommand() = default;
+
+    void execute() override;
+};
+
 class JobsList {
 public:
     class JobEntry {
@@ -178,12 +248,22 @@ public:
         pid_t pid;
         Command *cmd;
         STATUS status;
-        time_t startTime;
+        time_t startTime; // queued jobs: when they were queued
+        long long startNs; // monotonic, for the wall time
+        int priority; // higher starts first in ORDER_PRIORITY
+        int exitStatus; // as exitCode, once its (last) process exited
+        struct rusage usage; // of its processes the table reaped
+        int prevStopped; // slots of the neighbours in the stopped list, or
+        int nextStopped; // NO_SLOT. kept by JobsList
+
+        friend class JobsList;
 
     public:
 
         JobEntry(int jobId, int pid, Command *cmd, STATUS status) :
-                jobId(jobId), pid(pid), cmd(cmd), status(status) {
+                jobId(jobId), pid(pid), cmd(cmd), status(status),
+                startNs(monotonicNs()), priority(0), exitStatus(0), usage(),
+                prevStopped(NO_SLOT), nextStopped(NO_SLOT) {
             startTime = time(NULL);
             if (startTime == (time_t) (-1)) {
                 perror("smash error: time failed");
@@ -204,38 +284,74 @@ public:
             return cmd;
         }
 
-        void setCommandToNull() {
-            cmd = NULL;
-        }
-
         STATUS getStatus() const {
             return status;
         }
 
-        void setStatus(STATUS newStatus) {
-            status = newStatus;
-        }
-
         time_t getStartTime() const {
             return startTime;
         }
 
         void setStartTimeNow() {
+            startNs = monotonicNs();
             startTime = time(NULL);
             if (startTime == (time_t) (-1)) {
                 perror("smash error: time failed");
             }
         }
 
-        bool operator==(const JobEntry &entry) {
-            return jobId == entry.jobId;
-        }
+    };
+
+    //a job, or a cmd that ran in the foreground, that finished
+    struct FinishedJob {
+        int jobId; // 0 if it never was a job
+        string cmdLine;
+        int exitStatus;
+        long long wallNs; // from its start until smash reaped it
+        struct rusage usage;
     };
 
 private:
     int maxId;
 
-    list<JobEntry> jobsList;
+    //the entries are kept dense in no particular order, a removed entry is
+    // replaced by the last one. the indexes map to their slots, so every
+    // lookup is O(1). pointers to entries are valid until the next
+    // addJob or remove
+    std::vector<JobEntry> jobsList;
+    std::unordered_map<pid_t, int> slotByPid;
+    std::unordered_map<pid_t, int> jobIdByChild; // every process of a job
+    std::vector<int> slotById; // indexed by jobId, NO_SLOT for unused ids
+    int stoppedHead; // the stopped jobs, in jobId order
+    int stoppedTail;
+    int runningJobs;
+    std::deque<int> queue; // the jobIds of the queued jobs, in arrival order
+    int admittingId; // the queued job addJob fills in, 0 if none
+    AdmissionPolicy policy;
+    std::deque<FinishedJob> finished; // the last FINISHED_HISTORY, oldest first
+
+    void linkStopped(int slot);
+
+    void unlinkStopped(int slot);
+
+    //moves the entry in slot from to slot to, fixing the indexes
+    void moveEntry(int from, int to);
+
+    //deletes the cmd of the entry too, the table owns the cmds of its jobs
+    void removeSlot(int slot);
+
+    //updates the job of a child wait4 reported on
+    void childChanged(pid_t pid, int status, const struct rusage &used);
+
+    //the next queued job to start by the order of the policy
+    int nextQueued() const;
+
+    //stops or starts the retry timer by why the queue waits
+    void holdQueue();
+
+    void recordFinished(int jobId, const Command *cmd, int exitStatus,
+                        long long wallNs, const struct rusage &usage);
+
 
 public:
     JobsList();
@@ -244,16 +360,64 @@ public:
 
     void addJob(Command *cmd, pid_t pid, bool isStopped = false);
 
+    //true if a new background job may start now
+    bool admits();
+
+    //adds cmd as a job that starts once the policy admits it
+    void queueJob(Command *cmd);
+
+    //starts the queued jobs the policy admits, in order
+    void admitQueued();
+
+    //starts a queued job now, whatever the policy says. the entry is
+    // removed if it fails to start
+    void startQueued(int jobId);
+
+    AdmissionPolicy &getPolicy() {
+        return policy;
+    }
+
+    int getRunningNum() const {
+        return runningJobs;
+    }
+
+    int getQueuedNum() const {
+        return queue.size();
+    }
+
+    //false if jobId isn't queued
+    bool setPriority(int jobId, int priority);
+
     void printJobsList();
 
     void killAllJobs();
 
+    //reaps every child that changed with wait4(-1), once per SIGCHLD. the
+    // statuses of the cmd a foreground wait waits for are stashed for it
     void removeFinishedJobs();
 
     JobEntry *getJobById(int jobId);
 
     void removeJobById(int jobId);
 
+    //records what the job used and removes it
+    void finishJob(int jobId, int exitStatus);
+
+    //records what a cmd that ran in the foreground used
+    void recordForeground(const Command *cmd, int exitStatus,
+                          long long wallNs);
+
+    //oldest first
+    const std::deque<FinishedJob> &getFinished() const {
+        return finished;
+    }
+
+    void printFinishedJobs() const;
+
+    //prints the jobs with what their processes (stages, children and their
+    // children) use now, in one sweep. returns the lines printed
+    int printJobsTop(ProcSampler &sampler, ostream &out);
+
     JobEntry *getLastJob(int *lastJobId);
 
     JobEntry *getLastStoppedJob(int *jobId);
@@ -262,6 +426,15 @@ public:
         return jobsList.empty();
     }
 
+    int getJobsNum() const {
+        return jobsList.size();
+    }
+
+    //the entries the table has room for before it grows
+    int getSlotsNum() const {
+        return jobsList.capacity();
+    }
+
     bool stoppedJobExists() const;
 
     void destroyCmds();
@@ -272,17 +445,25 @@ public:
 
     JobEntry *getJobByPid(pid_t pid);
 
-    JobEntry *getSoonestTimeoutEntry();
+    void setJobStatus(JobEntry *entry, STATUS status);
 };
 
 class ExternalCommand : public Command {
+    POOLED
 protected:
     JobsList *jobsList;
+    PathCache *paths; // NULL for cp
     bool isCpCmd;
+    bool directExec;
 public:
-    ExternalCommand(const char *cmd_line, JobsList *
-    jobs, bool isCpCmd = false) : Command(cmd_line), jobsList(jobs),
-                                  isCpCmd(isCpCmd) {
+    ExternalCommand(const char *cmd_line, ParsedLine &&parsed, JobsList *jobs,
+                    PathCache *paths, bool isCpCmd = false) :
+            Command(cmd_line, std::move(parsed)), jobsList(jobs),
+                                            paths(paths), isCpCmd(isCpCmd),
+                                            directExec(false) {
+        if (!isCpCmd) {
+            directExec = !needsShell(args);
+        }
     };
 
     virtual ~ExternalCommand() = default;
@@ -292,39 +473,68 @@ public:
     bool isCp() const {
         return isCpCmd;
     }
+
+    bool isDirectExec() const {
+        return directExec;
+    }
+
+    //launches the cmd as a child process, returns its pid or -1
+    virtual pid_t launch(const LaunchSpec &spec);
 };
 
 class PipeCommand : public Command {
-    Command *firstCmd;
-    Command *secondCmd;
+    POOLED
+    std::vector<Command *> stages;
+    std::vector<IO_CHARS> links;
+    std::vector<pid_t> stagePids; // NOT_FORKED once reaped
+    int aliveStages;
+    pid_t pgid;
+    pid_t lastStagePid; // its status is the pipe's
     JobsList *jobsList;
+
+    pid_t launchStage(Command *stage, const LaunchSpec &spec);
+
+    void stageExited(pid_t pid);
+
 public:
-    PipeCommand(const char *cmd_line, JobsList *jobsList) :
-            Command(cmd_line), firstCmd(NULL), secondCmd(NULL),
-            jobsList(jobsList) {
+    PipeCommand(const char *cmd_line, ParsedLine &&parsed, JobsList *jobsList) :
+            Command(cmd_line, std::move(parsed)), stages(), links(),
+            stagePids(), aliveStages(0),
+            pgid(NOT_FORKED), lastStagePid(NOT_FORKED), jobsList(jobsList) {
+        type = PIPE;
+        piped = true;
+        grouped = true;
+        redirected = false; //redirections belong to the stages
     };
 
     virtual ~PipeCommand() {
-        delete firstCmd;
-        delete secondCmd;
+        for (unsigned int i = 0; i < stages.size(); i++) {
+            delete stages[i];
+        }
     }
 
-    void setFirstCmd(Command *first) {
-        firstCmd = first;
-    }
-
-    void setSecondCmd(Command *second) {
-        secondCmd = second;
-    }
+    //link is the pipe type from this stage to the next one
+    void addStage(Command *stage, IO_CHARS link);
 
     void execute() override;
+
+    void waitForeground(pid_t pid) override;
+
+    std::vector<pid_t> getChildPids(pid_t pid) const override;
+
+    bool childExited(pid_t pid) override;
+
+    pid_t getStatusPid(pid_t pid) const override {
+        return lastStagePid;
+    }
 };
 
 class JobsCommand : public BuiltInCommand {
+    POOLED
     JobsList *jobsList;
 public:
-    JobsCommand(const char *cmd_line, JobsList *jobs) : BuiltInCommand
-                                                                (cmd_line),
+    JobsCommand(const char *cmd_line, ParsedLine &&parsed, JobsList *jobs) :
+            BuiltInCommand(cmd_line, std::move(parsed)),
                                                         jobsList(jobs) {
     };
 
@@ -333,11 +543,38 @@ public:
     void execute() override;
 };
 
+class HashCommand : public BuiltInCommand {
+    POOLED
+    PathCache *paths;
+public:
+    HashCommand(const char *cmd_line, ParsedLine &&parsed, PathCache *paths) :
+            BuiltInCommand(cmd_line, std::move(parsed)), paths(paths) {
+    };
+
+    virtual ~HashCommand() = default;
+
+    void execute() override;
+};
+
+class TypeCommand : public BuiltInCommand {
+    POOLED
+    PathCache *paths;
+public:
+    TypeCommand(const char *cmd_line, ParsedLine &&parsed, PathCache *paths) :
+            BuiltInCommand(cmd_line, std::move(parsed)), paths(paths) {
+    };
+
+    virtual ~TypeCommand() = default;
+
+    void execute() override;
+};
+
 class KillCommand : public BuiltInCommand {
+    POOLED
     JobsList *jobsList;
 public:
-    KillCommand(const char *cmd_line, JobsList *jobs) : BuiltInCommand(
-            cmd_line), jobsList(jobs) {
+    KillCommand(const char *cmd_line, ParsedLine &&parsed, JobsList *jobs) :
+            BuiltInCommand(cmd_line, std::move(parsed)), jobsList(jobs) {
     };
 
     virtual ~KillCommand() = default;
@@ -346,11 +583,12 @@ public:
 };
 
 class ForegroundCommand : public BuiltInCommand {
+    POOLED
     JobsList *jobsList;
 public:
-    ForegroundCommand(const char *cmd_line, JobsList *jobs)
-            : BuiltInCommand
-                      (cmd_line),
+    ForegroundCommand(const char *cmd_line, ParsedLine &&parsed,
+                      JobsList *jobs)
+            : BuiltInCommand(cmd_line, std::move(parsed)),
               jobsList(jobs) {
     };
 
@@ -360,11 +598,12 @@ public:
 };
 
 class BackgroundCommand : public BuiltInCommand {
+    POOLED
     JobsList *jobsList;
 public:
-    BackgroundCommand(const char *cmd_line, JobsList *jobs)
-            : BuiltInCommand
-                      (cmd_line),
+    BackgroundCommand(const char *cmd_line, ParsedLine &&parsed,
+                      JobsList *jobs)
+            : BuiltInCommand(cmd_line, std::move(parsed)),
               jobsList(jobs) {
     };
 
@@ -374,32 +613,109 @@ public:
 };
 
 class CopyCommand : public ExternalCommand {
+    POOLED
+    CopyProgress *progress; // shared with the cp process
+    uint64_t lastCopied; // the last sample, the rate is measured from it
+    struct timespec lastSample;
+    double rate; // bytes per second
+public:
+    CopyCommand(const char *cmd_line, ParsedLine &&parsed,
+                JobsList *jobsList) :
+            ExternalCommand(cmd_line, std::move(parsed), jobsList, NULL, true),
+            progress(createCopyProgress()), lastCopied(0), lastSample(),
+            rate(0) {
+    };
+
+    virtual ~CopyCommand() {
+        destroyCopyProgress(progress);
+    }
+
+    pid_t launch(const LaunchSpec &spec) override;
+
+    string getProgress() override;
+
+    void execute() override;
+};
+
+class ParallelCommand : public ExternalCommand {
+    POOLED
+    ParallelOptions options;
+    ParallelProgress *progress; // shared with the supervisor process
+public:
+    ParallelCommand(const char *cmd_line, ParsedLine &&parsed,
+                    JobsList *jobsList,
+                    PathCache *paths) :
+            ExternalCommand(cmd_line, std::move(parsed), jobsList, paths),
+            options(),
+            progress(createParallelProgress()) {
+        grouped = true;
+    };
+
+    virtual ~ParallelCommand() {
+        destroyParallelProgress(progress);
+    }
+
+    pid_t launch(const LaunchSpec &spec) override;
+
+    string getProgress() override;
+
+    void execute() override;
+};
+
+class LastJobCommand : public BuiltInCommand {
+    POOLED
+    JobsList *jobsList;
+public:
+    LastJobCommand(const char *cmd_line, ParsedLine &&parsed, JobsList *jobs) :
+            BuiltInCommand(cmd_line, std::move(parsed)), jobsList(jobs) {
+    };
+
+    virtual ~LastJobCommand() = default;
+
+    void execute() override;
+};
+
+class JtopCommand : public BuiltInCommand {
+    POOLED
+    JobsList *jobsList;
 public:
-    CopyCommand(const char *cmd_line, JobsList *jobsList) :
-            ExternalCommand(cmd_line, jobsList, true) {
+    JtopCommand(const char *cmd_line, ParsedLine &&parsed, JobsList *jobs) :
+            BuiltInCommand(cmd_line, std::move(parsed)), jobsList(jobs) {
     };
 
-    virtual ~CopyCommand() = default;
+    virtual ~JtopCommand() = default;
+
+    void execute() override;
+};
+
+class SchedCommand : public BuiltInCommand {
+    POOLED
+    JobsList *jobsList;
+public:
+    SchedCommand(const char *cmd_line, ParsedLine &&parsed, JobsList *jobs) :
+            BuiltInCommand(cmd_line, std::move(parsed)), jobsList(jobs) {
+    };
+
+    virtual ~SchedCommand() = default;
 
     void execute() override;
 };
 
 class TimeoutCommand : public Command {
+    POOLED
     Command *innerCmd;
     JobsList *jobsList;
-    int duration;
-    time_t endingTime;
+    long long duration; // ns
+    long long deadline; // CLOCK_MONOTONIC ns
 
 public:
-    TimeoutCommand(const char *cmd_line, JobsList *jobsList) :
-            Command(cmd_line), innerCmd(NULL), jobsList(jobsList), duration(0), endingTime(0) {
+    TimeoutCommand(const char *cmd_line, ParsedLine &&parsed,
+                   JobsList *jobsList) :
+            Command(cmd_line, std::move(parsed)), innerCmd(NULL),
+            jobsList(jobsList), duration(0), deadline(0) {
 
     };
 
-    time_t getEndingTime() const {
-        return endingTime;
-    }
-
     virtual ~TimeoutCommand() {
         delete innerCmd;
     }
@@ -421,8 +737,12 @@ private:
 
     JobsList jobsList;
 
+    PathCache pathCache;
+
     bool toQuit;
 
+    void runCommand(const char *cmd_line);
+
 public:
     Command *CreateCommand(const char *cmd_line);
 
@@ -451,16 +771,22 @@ public:
         toQuit = quit;
     }
 
+    void reapJobs() {
+        jobsList.removeFinishedJobs();
+        jobsList.admitQueued();
+    }
+
     ~SmallShell();
 
     void executeCommand(const char *cmd_line);
 };
 
 class ChangePrompt : public BuiltInCommand {
+    POOLED
     SmallShell *smallShell;
 public:
-    ChangePrompt(const char *cmd_line, SmallShell *smash) :
-            BuiltInCommand(cmd_line), smallShell(smash) {
+    ChangePrompt(const char *cmd_line, ParsedLine &&parsed, SmallShell *smash) :
+            BuiltInCommand(cmd_line, std::move(parsed)), smallShell(smash) {
     };
 
     virtual ~ChangePrompt() = default;
@@ -469,12 +795,13 @@ public:
 };
 
 class QuitCommand : public BuiltInCommand {
+    POOLED
     JobsList *jobsList;
     SmallShell *smash;
 public:
-    QuitCommand(const char *cmd_line, JobsList *jobs, SmallShell *smash) :
-            BuiltInCommand
-                    (cmd_line),
+    QuitCommand(const char *cmd_line, ParsedLine &&parsed, JobsList *jobs,
+                SmallShell *smash) :
+            BuiltInCommand(cmd_line, std::move(parsed)),
             jobsList(jobs),
             smash(smash) {
     };
@@ -484,9 +811,8 @@ public:
     void execute() override;
 };
 
-extern JobsList alarmList;
-extern pid_t nextAlarmedPid;
+void expireTimeouts();
 
-void removeTimeoutAndSetNewAlarm(pid_t finishedPid);
+int signalCmd(const Command *cmd, pid_t pid, int sig);
 
 #endif //SMASH_COMMAND_H_
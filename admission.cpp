@@ -0,0 +1,73 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "admission.h"
+
+#define PSI_READ_SIZE (256)
+
+AdmissionPolicy::~AdmissionPolicy() {
+    if (cpuFd != -1) {
+        close(cpuFd);
+    }
+    if (memoryFd != -1) {
+        close(memoryFd);
+    }
+}
+
+//the pressure file is opened the first time it is needed
+static double readPressure(int *fd, const char *path) {
+    if (*fd == -1) {
+        *fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (*fd == -1) {
+            return -1;
+        }
+    }
+    char buffer[PSI_READ_SIZE];
+    ssize_t size = pread(*fd, buffer, PSI_READ_SIZE - 1, 0);
+    if (size <= 0) {
+        return -1;
+    }
+    buffer[size] = '\0';
+    const char *avg10 = strstr(buffer, "some avg10=");
+    if (avg10 == NULL) {
+        return -1;
+    }
+    return strtod(avg10 + strlen("some avg10="), NULL);
+}
+
+double AdmissionPolicy::pressure(const char *resource) {
+    if (strcmp(resource, "cpu") == 0) {
+        return readPressure(&cpuFd, "/proc/pressure/cpu");
+    }
+    return readPressure(&memoryFd, "/proc/pressure/memory");
+}
+
+bool AdmissionPolicy::setCpuLimit(double limit) {
+    if (limit != NO_LIMIT && pressure("cpu") < 0) {
+        return false;
+    }
+    cpuLimit = limit;
+    return true;
+}
+
+bool AdmissionPolicy::setMemoryLimit(double limit) {
+    if (limit != NO_LIMIT && pressure("memory") < 0) {
+        return false;
+    }
+    memoryLimit = limit;
+    return true;
+}
+
+bool AdmissionPolicy::admits(int running) {
+    pressureHeld = false;
+    if (maxRunning != NO_LIMIT && running >= maxRunning) {
+        return false;
+    }
+    if ((cpuLimit != NO_LIMIT && pressure("cpu") > cpuLimit) ||
+        (memoryLimit != NO_LIMIT && pressure("memory") > memoryLimit)) {
+        pressureHeld = true;
+        return false;
+    }
+    return true;
+}
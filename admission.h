@@ -0,0 +1,79 @@
+#ifndef SMASH_ADMISSION_H_
+#define SMASH_ADMISSION_H_
+
+#define SCHED_RETRY_NS (1000000000LL) // pressure is re-checked every sec
+#define NO_LIMIT (0)
+
+typedef enum {
+    ORDER_FIFO, ORDER_PRIORITY
+} SCHED_ORDER;
+
+//when a background job may start. at most maxRunning jobs run at once, and
+// none start while the cpu or memory pressure (the PSI "some avg10" of
+// /proc/pressure, the % of the last 10 secs some task waited) is above
+// its limit. NO_LIMIT turns a limit off
+class AdmissionPolicy {
+    int maxRunning;
+    double cpuLimit;
+    double memoryLimit;
+    SCHED_ORDER order;
+    int cpuFd; // /proc/pressure/cpu, opened once and read with pread
+    int memoryFd;
+    bool pressureHeld; // the last refusal was because of pressure
+
+public:
+    AdmissionPolicy() : maxRunning(NO_LIMIT), cpuLimit(NO_LIMIT),
+                        memoryLimit(NO_LIMIT), order(ORDER_FIFO), cpuFd(-1),
+                        memoryFd(-1), pressureHeld(false) {
+    };
+
+    ~AdmissionPolicy();
+
+    AdmissionPolicy(const AdmissionPolicy &) = delete;
+
+    void operator=(const AdmissionPolicy &) = delete;
+
+    //true if another job may start while running jobs run
+    bool admits(int running);
+
+    //true if the queue waits for the pressure to drop, which nothing but
+    // time will report
+    bool heldByPressure() const {
+        return pressureHeld;
+    }
+
+    //the some avg10 of a resource ("cpu" or "memory"), -1 if the kernel
+    // has no PSI
+    double pressure(const char *resource);
+
+    void setMaxRunning(int max) {
+        maxRunning = max;
+    }
+
+    int getMaxRunning() const {
+        return maxRunning;
+    }
+
+    //false if PSI is unsupported
+    bool setCpuLimit(double limit);
+
+    double getCpuLimit() const {
+        return cpuLimit;
+    }
+
+    bool setMemoryLimit(double limit);
+
+    double getMemoryLimit() const {
+        return memoryLimit;
+    }
+
+    void setOrder(SCHED_ORDER newOrder) {
+        order = newOrder;
+    }
+
+    SCHED_ORDER getOrder() const {
+        return order;
+    }
+};
+
+#endif //SMASH_ADMISSION_H_
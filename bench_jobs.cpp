@@ -0,0 +1,71 @@
+#include <iostream>
+#include <vector>
+#include "Commands.h"
+#include "timers.h"
+
+#define BENCH_PID_BASE (1 << 22) // past pid_max, never a real process
+
+//a job cmd that never runs, the table deletes it on remove
+class BenchCommand : public Command {
+public:
+    explicit BenchCommand(const char *cmd_line) : Command(cmd_line) {
+    };
+
+    virtual ~BenchCommand() = default;
+
+    void execute() override {
+    };
+};
+
+static void report(const char *op, long long ns, int jobsNum) {
+    std::cout << "  " << op << ": " << ns / jobsNum << " ns/op" << std::endl;
+}
+
+//times addJob, the lookups by id and by pid, and removeJobById on a table
+// of jobsNum jobs. every op should cost the same at any size
+static void benchJobs(int jobsNum) {
+    std::vector<Command *> cmds;
+    for (int i = 0; i < jobsNum; i++) {
+        cmds.push_back(new BenchCommand("sleep 100&"));
+    }
+    JobsList jobs;
+    std::cout << jobsNum << " jobs:" << std::endl;
+
+    long long start = monotonicNs();
+    for (int i = 0; i < jobsNum; i++) {
+        jobs.addJob(cmds[i], BENCH_PID_BASE + i);
+    }
+    report("addJob", monotonicNs() - start, jobsNum);
+
+    int found = 0;
+    start = monotonicNs();
+    for (int i = 0; i < jobsNum; i++) {
+        found += jobs.getJobById(i + 1) != NULL;
+    }
+    report("getJobById", monotonicNs() - start, jobsNum);
+
+    start = monotonicNs();
+    for (int i = 0; i < jobsNum; i++) {
+        found += jobs.getJobByPid(BENCH_PID_BASE + i) != NULL;
+    }
+    report("getJobByPid", monotonicNs() - start, jobsNum);
+
+    //from the oldest, so every remove moves the last entry into the hole
+    start = monotonicNs();
+    for (int i = 0; i < jobsNum; i++) {
+        jobs.removeJobById(i + 1);
+    }
+    report("removeJobById", monotonicNs() - start, jobsNum);
+
+    if (found != 2 * jobsNum || jobs.getJobsNum() != 0) {
+        std::cerr << "smash error: bench_jobs: lost jobs" << std::endl;
+    }
+}
+
+int main() {
+    const int sizes[] = {1000, 10000, 100000};
+    for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        benchJobs(sizes[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <iostream>
+#include <vector>
+#include "timers.h"
+
+static void report(const char *op, long long ns, int opsNum) {
+    std::cout << "  " << op << ": " << ns / opsNum << " ns/op" << std::endl;
+}
+
+//times add, cancel and popDue on a queue of timersNum timers with
+// deadlines spread over an hour, in no order. each should grow as log n
+static void benchTimers(int timersNum) {
+    std::vector<long long> deadlines;
+    unsigned int seed = 1;
+    for (int i = 0; i < timersNum; i++) {
+        seed = seed * 1103515245 + 12345;
+        deadlines.push_back((seed % 3600000) * TIMER_TICK_NS);
+    }
+    TimerQueue timers;
+    std::cout << timersNum << " timers:" << std::endl;
+
+    long long start = monotonicNs();
+    for (int i = 0; i < timersNum; i++) {
+        timers.add(i + 1, deadlines[i], NULL);
+    }
+    report("add", monotonicNs() - start, timersNum);
+
+    //every other timer, like the cmds that finish before their timeout
+    int cancelled = 0;
+    start = monotonicNs();
+    for (int i = 0; i < timersNum; i += 2) {
+        cancelled += timers.cancel(i + 1);
+    }
+    report("cancel", monotonicNs() - start, cancelled);
+
+    std::vector<Timer> due;
+    due.reserve(timers.size());
+    start = monotonicNs();
+    timers.popDue(timers.nextDeadline() + 3600 * NS_PER_SEC, due);
+    report("popDue", monotonicNs() - start, due.size());
+
+    if (cancelled + (int) due.size() != timersNum || timers.size() != 0) {
+        std::cerr << "smash error: bench_timers: lost timers" << std::endl;
+    }
+}
+
+int main() {
+    const int sizes[] = {1000, 10000, 100000, 1000000};
+    for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        benchTimers(sizes[i]);
+    }
+    return 0;
+}
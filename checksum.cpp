@@ -0,0 +1,97 @@
+#include <string.h>
+#include "checksum.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#define CRC32C_POLY (0x82F63B78) // reversed Castagnoli polynomial
+
+typedef uint32_t (*Crc32cFunc)(uint32_t, const unsigned char *, size_t);
+
+//slicing-by-8 tables for the software version
+static uint32_t crcTable[8][256];
+
+static void initCrcTable() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0 - (crc & 1)));
+        }
+        crcTable[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int slice = 1; slice < 8; slice++) {
+            crcTable[slice][i] = (crcTable[slice - 1][i] >> 8) ^
+                                 crcTable[0][crcTable[slice - 1][i] & 0xFF];
+        }
+    }
+}
+
+static uint32_t crc32cSoftware(uint32_t crc, const unsigned char *data,
+                               size_t size) {
+    while (size >= 8) {
+        uint32_t low, high;
+        memcpy(&low, data, 4);
+        memcpy(&high, data + 4, 4);
+        low ^= crc;
+        crc = crcTable[7][low & 0xFF] ^ crcTable[6][(low >> 8) & 0xFF] ^
+              crcTable[5][(low >> 16) & 0xFF] ^ crcTable[4][low >> 24] ^
+              crcTable[3][high & 0xFF] ^ crcTable[2][(high >> 8) & 0xFF] ^
+              crcTable[1][(high >> 16) & 0xFF] ^ crcTable[0][high >> 24];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = (crc >> 8) ^ crcTable[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32cSse42(uint32_t crc, const unsigned char *data,
+                            size_t size) {
+    uint64_t crc64 = crc;
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        size -= 8;
+    }
+    crc = (uint32_t) crc64;
+    while (size-- > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+
+#endif
+
+static Crc32cFunc pickCrc32c() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        return crc32cSse42;
+    }
+#endif
+    initCrcTable();
+    return crc32cSoftware;
+}
+
+//picked on the first use rather than by a static initializer, which may
+// run before the cpu features are known
+static Crc32cFunc crc32cImpl() {
+    static Crc32cFunc picked = pickCrc32c();
+    return picked;
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t size) {
+    return ~crc32cImpl()(~crc, (const unsigned char *) data, size);
+}
+
+const char *crc32cImplName() {
+    return crc32cImpl() == crc32cSoftware ? "software" : "sse4.2";
+}
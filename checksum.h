@@ -0,0 +1,14 @@
+#ifndef SMASH_CHECKSUM_H_
+#define SMASH_CHECKSUM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+//CRC32C (Castagnoli) of data, continuing from crc (0 to start). uses the
+// SSE4.2 crc32 instruction when the cpu has it, picked once at runtime
+uint32_t crc32c(uint32_t crc, const void *data, size_t size);
+
+//the implementation crc32c picked, for reports
+const char *crc32cImplName();
+
+#endif //SMASH_CHECKSUM_H_
@@ -0,0 +1,1460 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <string>
+#include <new>
+#include <limits>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <linux/fs.h>
+#include <iomanip>
+#include <sstream>
+#include "copy.h"
+#include "status.h"
+#include "checksum.h"
+
+using namespace std;
+
+#define BUF_SIZE (4096)
+#define KERNEL_CHUNK (1 << 30) // max bytes per copy_file_range/sendfile call
+#define RANGE_BUF_SIZE (1 << 20)
+#define DEFAULT_CHUNK_SIZE (64 << 20)
+#define MAX_THREADS (64)
+#define DEFAULT_TREE_THREADS (8)
+#define MIN_UNCACHED_BUF (256 << 10)
+#define MAX_UNCACHED_BUF (8 << 20)
+#define DIRECT_ALIGN (4096)
+#define ZERO_BLOCK_SIZE (4096)
+#define INCREMENTAL_BLOCK_SIZE (1 << 20)
+#define CHECKPOINT_INTERVAL (64 << 20)
+#define CHECKPOINT_SUFFIX ".smash-cp"
+#define FANOUT_BUF_SIZE (4 << 20)
+#define OFF_T_MAX (std::numeric_limits<off_t>::max())
+#define CHECKSUM_BUF_SIZE (1 << 20)
+#define DROP_WINDOW (8 << 20) // copied bytes between page cache drops
+
+static CopyProgress *progress = NULL; // set in the cp process only
+
+CopyProgress *createCopyProgress() {
+    void *shared = mmap(NULL, sizeof(CopyProgress), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("smash error: mmap failed");
+        return NULL;
+    }
+    CopyProgress *created = new(shared) CopyProgress;
+    created->total = 0;
+    created->copied = 0;
+    return created;
+}
+
+void destroyCopyProgress(CopyProgress *progress) {
+    if (progress != NULL) {
+        munmap(progress, sizeof(CopyProgress));
+    }
+}
+
+static void addTotal(off_t bytes) {
+    if (progress != NULL) {
+        progress->total.fetch_add(bytes, std::memory_order_relaxed);
+    }
+}
+
+static void addCopied(off_t bytes) {
+    if (progress != NULL) {
+        progress->copied.fetch_add(bytes, std::memory_order_relaxed);
+    }
+}
+
+const char *copyStrategyName(COPY_STRATEGY strategy) {
+    switch (strategy) {
+        case COPY_REFLINK:
+            return "reflink";
+        case COPY_FILE_RANGE:
+            return "copy_file_range";
+        case COPY_SENDFILE:
+            return "sendfile";
+        case COPY_BUFFERED:
+            return "read/write";
+        case COPY_UNCACHED:
+            return "read/write without page cache";
+        case COPY_DIRECT:
+            return "O_DIRECT";
+        case COPY_SPARSE:
+            return "data extents";
+        case COPY_INCREMENTAL:
+            return "incremental";
+        case COPY_CHECKSUMMED:
+            return "read/write with crc32c";
+        default:
+            return "none";
+    }
+}
+
+//errors which mean the kernel can't do this kind of copy for these files,
+// so the next strategy should be tried
+static bool isUnsupported(int err) {
+    return err == EXDEV || err == ENOSYS || err == EOPNOTSUPP ||
+           err == ENOTSUP || err == EINVAL || err == ENOTTY || err == EBADF;
+}
+
+//0 - copied all, 1 - not supported (nothing more was copied), -1 - error
+static int copyWithReflink(int srcFd, int dstFd) {
+    if (lseek(srcFd, 0, SEEK_CUR) != 0 || lseek(dstFd, 0, SEEK_CUR) != 0) {
+        return 1; // FICLONE clones whole files only
+    }
+    if (ioctl(dstFd, FICLONE, srcFd) == -1) {
+        return 1;
+    }
+    addCopied(lseek(srcFd, 0, SEEK_END));
+    lseek(dstFd, 0, SEEK_END);
+    return 0;
+}
+
+static int copyWithFileRange(int srcFd, int dstFd) {
+    ssize_t copied;
+    while ((copied = copy_file_range(srcFd, NULL, dstFd, NULL, KERNEL_CHUNK,
+                                     0)) > 0) {
+        addCopied(copied);
+    }
+    if (copied == 0) {
+        return 0;
+    }
+    if (isUnsupported(errno)) {
+        return 1;
+    }
+    perror("smash error: copy_file_range failed");
+    return -1;
+}
+
+static int copyWithSendfile(int srcFd, int dstFd) {
+    ssize_t copied;
+    while ((copied = sendfile(dstFd, srcFd, NULL, KERNEL_CHUNK)) > 0) {
+        addCopied(copied);
+    }
+    if (copied == 0) {
+        return 0;
+    }
+    if (isUnsupported(errno)) {
+        return 1;
+    }
+    perror("smash error: sendfile failed");
+    return -1;
+}
+
+static int copyWithBuffer(int srcFd, int dstFd) {
+    char buffer[BUF_SIZE] = "";
+    ssize_t readSize;
+    while ((readSize = read(srcFd, buffer, BUF_SIZE)) > 0) {
+        ssize_t written = 0;
+        while (written < readSize) {
+            ssize_t writeStatus = write(dstFd, buffer + written,
+                                        readSize - written);
+            if (writeStatus == -1) {
+                perror("smash error: write failed");
+                return -1;
+            }
+            written += writeStatus;
+        }
+        addCopied(readSize);
+    }
+    if (readSize == -1) {//read failed
+        perror("smash error: read failed");
+        return -1;
+    }
+    return 0;
+}
+
+int copyFd(int srcFd, int dstFd) {
+    typedef int (*CopyFunc)(int, int);
+    const CopyFunc strategies[] = {copyWithReflink, copyWithFileRange,
+                                   copyWithSendfile, copyWithBuffer};
+    //a strategy that isn't supported may still have copied a part, the
+    // next one continues from the current offsets
+    for (int i = COPY_REFLINK; i <= COPY_BUFFERED; i++) {
+        int res = strategies[i](srcFd, dstFd);
+        if (res == 0) {
+            return i;
+        }
+        if (res == -1) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+//drops the pages of a copy from the page cache behind its cursor, so only
+// about two windows of it are cached at any time. writeback of a filled
+// window starts at once and is waited for when the next one fills, dirty
+// pages can't be dropped before. each cp worker keeps its own
+class DropBehind {
+    int srcFd;
+    int dstFd;
+    off_t window;
+    off_t start; // the window being filled is [start, cursor)
+    off_t cursor;
+    off_t writingStart; // the window being written back
+    off_t writingEnd;
+
+    //starts writeback of the filled window, waits for the one before it
+    // and drops it
+    void endWindow() {
+        if (cursor > start) {
+            sync_file_range(dstFd, start, cursor - start,
+                            SYNC_FILE_RANGE_WRITE);
+        }
+        if (writingEnd > writingStart) {
+            sync_file_range(dstFd, writingStart, writingEnd - writingStart,
+                            SYNC_FILE_RANGE_WAIT_BEFORE |
+                            SYNC_FILE_RANGE_WRITE |
+                            SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(dstFd, writingStart, writingEnd - writingStart,
+                          POSIX_FADV_DONTNEED);
+            posix_fadvise(srcFd, writingStart, writingEnd - writingStart,
+                          POSIX_FADV_DONTNEED);
+        }
+        writingStart = start;
+        writingEnd = cursor;
+        start = cursor;
+    }
+
+public:
+    DropBehind(int srcFd, int dstFd, off_t window) :
+            srcFd(srcFd), dstFd(dstFd), window(window), start(0), cursor(0),
+            writingStart(0), writingEnd(0) {
+    };
+
+    //length bytes were copied at offset. a copy that goes on elsewhere
+    // (the next range of a worker, the next extent) ends the window
+    void copied(off_t offset, off_t length) {
+        if (offset != cursor) {
+            endWindow();
+            start = offset;
+            cursor = offset;
+        }
+        cursor += length;
+        if (cursor - start >= window) {
+            endWindow();
+        }
+    }
+
+    //drops the rest of the copy
+    void finish() {
+        endWindow();
+        endWindow();
+    }
+};
+
+//copies [offset, offset + length) at explicit offsets, so workers don't
+// share file offsets. falls back to pread/pwrite if copy_file_range can't
+// be used for these files. with drop, it copies a window at a time and
+// drops them behind
+static bool copyRange(int srcFd, int dstFd, off_t offset, off_t length,
+                      bool *useFileRange, vector<char> &buffer,
+                      DropBehind *drop) {
+    off_t end = offset + length;
+    while (*useFileRange && offset < end) {
+        loff_t inOff = offset, outOff = offset;
+        off_t toCopy = drop != NULL && end - offset > DROP_WINDOW ?
+                       DROP_WINDOW : end - offset;
+        ssize_t copied = copy_file_range(srcFd, &inOff, dstFd, &outOff,
+                                         toCopy, 0);
+        if (copied == 0) {
+            return true; // source is shorter than expected
+        }
+        if (copied == -1) {
+            if (!isUnsupported(errno)) {
+                return false;
+            }
+            *useFileRange = false;
+            break;
+        }
+        addCopied(copied);
+        if (drop != NULL) {
+            drop->copied(offset, copied);
+        }
+        offset += copied;
+    }
+    while (offset < end) {
+        size_t toRead = end - offset < (off_t) buffer.size() ?
+                        (size_t) (end - offset) : buffer.size();
+        ssize_t readSize = pread(srcFd, buffer.data(), toRead, offset);
+        if (readSize <= 0) {
+            return readSize == 0;
+        }
+        ssize_t written = 0;
+        while (written < readSize) {
+            ssize_t writeStatus = pwrite(dstFd, buffer.data() + written,
+                                         readSize - written, offset + written);
+            if (writeStatus == -1) {
+                return false;
+            }
+            written += writeStatus;
+        }
+        addCopied(readSize);
+        if (drop != NULL) {
+            drop->copied(offset, readSize);
+        }
+        offset += readSize;
+    }
+    return true;
+}
+
+int copyParallel(int srcFd, int dstFd, off_t size,
+                 const CopyOptions &options) {
+    if (fallocate(dstFd, 0, 0, size) == -1 && ftruncate(dstFd, size) == -1) {
+        perror("smash error: ftruncate failed");
+        return -1;
+    }
+    std::atomic<off_t> nextOffset(0);
+    std::atomic<bool> failed(false);
+    std::atomic<bool> usedBuffered(false);
+    std::atomic<int> copyErrno(0);
+    bool dropBehind = options.cacheMode == CACHE_DROP;
+    auto worker = [&]() {
+        bool useFileRange = true;
+        vector<char> buffer(RANGE_BUF_SIZE);
+        DropBehind drop(srcFd, dstFd, DROP_WINDOW); // of its own ranges
+        off_t offset;
+        while (!failed && (offset = nextOffset.fetch_add(options.chunkSize))
+                          < size) {
+            off_t length = size - offset < options.chunkSize ?
+                           size - offset : options.chunkSize;
+            if (!copyRange(srcFd, dstFd, offset, length, &useFileRange,
+                           buffer, dropBehind ? &drop : NULL)) {
+                copyErrno = errno;
+                failed = true;
+            }
+        }
+        if (dropBehind) {
+            drop.finish();
+        }
+        if (!useFileRange) {
+            usedBuffered = true;
+        }
+    };
+    vector<std::thread> workers;
+    for (int i = 1; i < options.threads; i++) {
+        workers.push_back(std::thread(worker));
+    }
+    worker();
+    for (unsigned int i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+    if (failed) {
+        errno = copyErrno;
+        perror("smash error: copy failed");
+        return -1;
+    }
+    return usedBuffered ? COPY_BUFFERED : COPY_FILE_RANGE;
+}
+
+//big enough buffers to keep the device busy, a multiple of both files
+// block sizes (so O_DIRECT stays aligned)
+static size_t uncachedBufSize(int srcFd, int dstFd, off_t size) {
+    struct stat srcStat, dstStat;
+    size_t blockSize = DIRECT_ALIGN;
+    if (fstat(srcFd, &srcStat) == 0 && (size_t) srcStat.st_blksize > blockSize) {
+        blockSize = srcStat.st_blksize;
+    }
+    if (fstat(dstFd, &dstStat) == 0 && (size_t) dstStat.st_blksize > blockSize) {
+        blockSize = dstStat.st_blksize;
+    }
+    size_t bufSize = size / 64;
+    if (bufSize < MIN_UNCACHED_BUF) {
+        bufSize = MIN_UNCACHED_BUF;
+    } else if (bufSize > MAX_UNCACHED_BUF) {
+        bufSize = MAX_UNCACHED_BUF;
+    }
+    return (bufSize + blockSize - 1) / blockSize * blockSize;
+}
+
+//sets or clears O_DIRECT, false if the file system doesn't support it
+static bool setDirect(int fd, bool direct) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1) {
+        return false;
+    }
+    flags = direct ? flags | O_DIRECT : flags & ~O_DIRECT;
+    return fcntl(fd, F_SETFL, flags) == 0;
+}
+
+//drops the pages of a finished copy from the page cache. the dirty pages
+// of dstFd are written back first, they can't be dropped before that
+static void dropCopied(int srcFd, int dstFd) {
+    fdatasync(dstFd);
+    posix_fadvise(dstFd, 0, 0, POSIX_FADV_DONTNEED);
+    posix_fadvise(srcFd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+int copyUncached(int srcFd, int dstFd, off_t size, bool direct) {
+    if (direct && (!setDirect(srcFd, true) || !setDirect(dstFd, true))) {
+        setDirect(srcFd, false);
+        direct = false; // fall back to dropping the pages ourselves
+    }
+    size_t bufSize = uncachedBufSize(srcFd, dstFd, size);
+    void *buffer = mmap(NULL, bufSize, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); // page aligned
+    if (buffer == MAP_FAILED) {
+        perror("smash error: mmap failed");
+        return -1;
+    }
+    posix_fadvise(srcFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    DropBehind drop(srcFd, dstFd, (off_t) bufSize * 4);
+    off_t offset = 0;
+    ssize_t readSize;
+    bool success = true;
+    while (success && (readSize = read(srcFd, buffer, bufSize)) > 0) {
+        //O_DIRECT writes must be whole blocks, the tail is cut afterwards
+        size_t toWrite = direct ? (readSize + DIRECT_ALIGN - 1) /
+                                  DIRECT_ALIGN * DIRECT_ALIGN : readSize;
+        if (toWrite != (size_t) readSize) {
+            memset((char *) buffer + readSize, 0, toWrite - readSize);
+        }
+        size_t written = 0;
+        while (written < toWrite) {
+            ssize_t writeStatus = write(dstFd, (char *) buffer + written,
+                                        toWrite - written);
+            if (writeStatus == -1) {
+                perror("smash error: write failed");
+                success = false;
+                break;
+            }
+            written += writeStatus;
+        }
+        addCopied(readSize);
+        if (!direct) {
+            drop.copied(offset, readSize);
+        }
+        offset += readSize;
+    }
+    if (success && readSize == -1) {//read failed
+        perror("smash error: read failed");
+        success = false;
+    }
+    munmap(buffer, bufSize);
+    if (success && direct && ftruncate(dstFd, offset) == -1) {
+        perror("smash error: ftruncate failed");
+        success = false;
+    }
+    if (!direct) {
+        drop.finish();
+    }
+    if (!success) {
+        return -1;
+    }
+    return direct ? COPY_DIRECT : COPY_UNCACHED;
+}
+
+static bool isZeroBlock(const char *block, size_t size) {
+    return block[0] == 0 && memcmp(block, block + 1, size - 1) == 0;
+}
+
+//copies [offset, offset + length) leaving out the zero blocks, which stay
+// holes in dstFd
+static bool copyRangeSkipZeros(int srcFd, int dstFd, off_t offset,
+                               off_t length, vector<char> &buffer,
+                               DropBehind *drop) {
+    off_t end = offset + length;
+    while (offset < end) {
+        size_t toRead = end - offset < (off_t) buffer.size() ?
+                        (size_t) (end - offset) : buffer.size();
+        ssize_t readSize = pread(srcFd, buffer.data(), toRead, offset);
+        if (readSize <= 0) {
+            return readSize == 0;
+        }
+        for (ssize_t block = 0; block < readSize; block += ZERO_BLOCK_SIZE) {
+            size_t blockSize = readSize - block < ZERO_BLOCK_SIZE ?
+                               readSize - block : ZERO_BLOCK_SIZE;
+            if (isZeroBlock(buffer.data() + block, blockSize)) {
+                continue;
+            }
+            ssize_t written = 0;
+            while (written < (ssize_t) blockSize) {
+                ssize_t writeStatus = pwrite(dstFd,
+                                             buffer.data() + block + written,
+                                             blockSize - written,
+                                             offset + block + written);
+                if (writeStatus == -1) {
+                    return false;
+                }
+                written += writeStatus;
+            }
+        }
+        addCopied(readSize);
+        if (drop != NULL) {
+            drop->copied(offset, readSize);
+        }
+        offset += readSize;
+    }
+    return true;
+}
+
+int copySparse(int srcFd, int dstFd, off_t size, bool detectZeros,
+               bool dropBehind) {
+    struct stat dstStat;
+    off_t dstSize = fstat(dstFd, &dstStat) == 0 ? dstStat.st_size : 0;
+    vector<char> buffer(RANGE_BUF_SIZE);
+    DropBehind drop(srcFd, dstFd, DROP_WINDOW);
+    bool useFileRange = true;
+    off_t data, hole = 0;
+    while (hole < size) {
+        data = lseek(srcFd, hole, SEEK_DATA);
+        if (data == -1 && errno == ENXIO) {
+            data = size; // only a hole is left
+        } else if (data == -1) { // no SEEK_DATA here, the file is all data
+            data = hole;
+        }
+        //dstFd may already hold data where the source has a hole
+        if (data > hole && hole < dstSize &&
+            fallocate(dstFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      hole, data - hole) == -1) {
+            perror("smash error: fallocate failed");
+            return -1;
+        }
+        addCopied(data - hole); // the holes count as copied
+        if (data >= size) {
+            break;
+        }
+        hole = lseek(srcFd, data, SEEK_HOLE);
+        if (hole == -1 || hole > size) {
+            hole = size;
+        }
+        DropBehind *dropUsed = dropBehind ? &drop : NULL;
+        bool copied = detectZeros ?
+                      copyRangeSkipZeros(srcFd, dstFd, data, hole - data,
+                                         buffer, dropUsed) :
+                      copyRange(srcFd, dstFd, data, hole - data,
+                                &useFileRange, buffer, dropUsed);
+        if (!copied) {
+            perror("smash error: copy failed");
+            return -1;
+        }
+    }
+    if (dropBehind) {
+        drop.finish();
+    }
+    if (ftruncate(dstFd, size) == -1) { // recreates a hole at the end
+        perror("smash error: ftruncate failed");
+        return -1;
+    }
+    return COPY_SPARSE;
+}
+
+//the checkpoint of an interrupted incremental copy, kept next to the
+// destination. it is only trusted for the same unchanged source
+typedef struct {
+    char magic[8];
+    dev_t srcDev;
+    ino_t srcIno;
+    off_t srcSize;
+    struct timespec srcMtime;
+    off_t verifiedOffset;
+} CopyCheckpoint;
+
+static const char CHECKPOINT_MAGIC[8] = "smashcp";
+
+static void fillCheckpoint(CopyCheckpoint *checkpoint,
+                           const struct stat &srcStat, off_t offset) {
+    memset(checkpoint, 0, sizeof(CopyCheckpoint));
+    memcpy(checkpoint->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    checkpoint->srcDev = srcStat.st_dev;
+    checkpoint->srcIno = srcStat.st_ino;
+    checkpoint->srcSize = srcStat.st_size;
+    checkpoint->srcMtime = srcStat.st_mtim;
+    checkpoint->verifiedOffset = offset;
+}
+
+//returns the offset up to which the destination is known to match the
+// source, 0 if there is no valid checkpoint
+static off_t readCheckpoint(const string &path, const struct stat &srcStat) {
+    CopyCheckpoint saved, expected;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+    ssize_t readSize = read(fd, &saved, sizeof(saved));
+    close(fd);
+    if (readSize != sizeof(saved)) {
+        return 0;
+    }
+    fillCheckpoint(&expected, srcStat, saved.verifiedOffset);
+    if (memcmp(&saved, &expected, sizeof(saved)) != 0 ||
+        saved.verifiedOffset > srcStat.st_size) {
+        return 0;
+    }
+    return saved.verifiedOffset;
+}
+
+static void writeCheckpoint(int fd, const struct stat &srcStat,
+                            off_t offset) {
+    CopyCheckpoint checkpoint;
+    fillCheckpoint(&checkpoint, srcStat, offset);
+    if (pwrite(fd, &checkpoint, sizeof(checkpoint), 0) == -1) {
+        perror("smash error: write failed");
+    }
+}
+
+int copyIncremental(int srcFd, int dstFd, const char *dstPath,
+                    const struct stat &srcStat, bool verbose) {
+    string checkpointPath = string(dstPath) + CHECKPOINT_SUFFIX;
+    off_t offset = readCheckpoint(checkpointPath, srcStat);
+    off_t resumedFrom = offset;
+    int checkpointFd = open(checkpointPath.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (checkpointFd == -1) {
+        perror("smash error: open failed");
+        return -1;
+    }
+    addCopied(offset);
+    posix_fadvise(srcFd, offset, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(dstFd, offset, 0, POSIX_FADV_SEQUENTIAL);
+    vector<char> srcBuf(INCREMENTAL_BLOCK_SIZE), dstBuf(INCREMENTAL_BLOCK_SIZE);
+    off_t lastCheckpoint = offset;
+    unsigned long blocks = 0, rewritten = 0;
+    bool success = true;
+    while (offset < srcStat.st_size) {
+        ssize_t srcSize = pread(srcFd, srcBuf.data(), srcBuf.size(), offset);
+        if (srcSize <= 0) {
+            if (srcSize == -1) {
+                perror("smash error: read failed");
+                success = false;
+            }
+            break;
+        }
+        ssize_t dstSize = pread(dstFd, dstBuf.data(), srcSize, offset);
+        if (dstSize == -1) {
+            perror("smash error: read failed");
+            success = false;
+            break;
+        }
+        blocks++;
+        if (dstSize != srcSize ||
+            memcmp(srcBuf.data(), dstBuf.data(), srcSize) != 0) {
+            rewritten++;
+            ssize_t written = 0;
+            while (written < srcSize) {
+                ssize_t writeStatus = pwrite(dstFd, srcBuf.data() + written,
+                                             srcSize - written,
+                                             offset + written);
+                if (writeStatus == -1) {
+                    perror("smash error: write failed");
+                    success = false;
+                    break;
+                }
+                written += writeStatus;
+            }
+            if (!success) {
+                break;
+            }
+        }
+        addCopied(srcSize);
+        offset += srcSize;
+        if (offset - lastCheckpoint >= CHECKPOINT_INTERVAL) {
+            //the checkpoint may only cover data that reached the disk
+            fdatasync(dstFd);
+            writeCheckpoint(checkpointFd, srcStat, offset);
+            lastCheckpoint = offset;
+        }
+    }
+    close(checkpointFd);
+    if (!success) {
+        return -1; // the checkpoint stays, to resume from it next time
+    }
+    if (ftruncate(dstFd, srcStat.st_size) == -1) {
+        perror("smash error: ftruncate failed");
+        return -1;
+    }
+    unlink(checkpointPath.c_str());
+    if (verbose) {
+        cout << "smash: cp: " << rewritten << " of " << blocks
+             << " blocks rewritten";
+        if (resumedFrom > 0) {
+            cout << ", resumed from offset " << resumedFrom;
+        }
+        cout << endl;
+    }
+    return COPY_INCREMENTAL;
+}
+
+int copyChecksummed(int srcFd, int dstFd, uint32_t *crc, bool holes,
+                    bool dropBehind) {
+    vector<char> buffer(CHECKSUM_BUF_SIZE);
+    DropBehind drop(srcFd, dstFd, DROP_WINDOW);
+    ssize_t readSize;
+    off_t offset = 0;
+    *crc = 0;
+    posix_fadvise(srcFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    while ((readSize = read(srcFd, buffer.data(), buffer.size())) > 0) {
+        *crc = crc32c(*crc, buffer.data(), readSize);
+        ssize_t stride = holes ? ZERO_BLOCK_SIZE : readSize; // one write
+        for (ssize_t block = 0; dstFd != -1 && block < readSize;
+             block += stride) {
+            size_t blockSize = readSize - block < stride ?
+                               readSize - block : stride;
+            if (holes && isZeroBlock(buffer.data() + block, blockSize)) {
+                continue;
+            }
+            ssize_t written = 0;
+            while (written < (ssize_t) blockSize) {
+                ssize_t writeStatus = pwrite(dstFd,
+                                             buffer.data() + block + written,
+                                             blockSize - written,
+                                             offset + block + written);
+                if (writeStatus == -1) {
+                    perror("smash error: write failed");
+                    return -1;
+                }
+                written += writeStatus;
+            }
+        }
+        addCopied(readSize);
+        if (dropBehind && dstFd != -1) {
+            drop.copied(offset, readSize);
+        }
+        offset += readSize;
+    }
+    if (dropBehind && dstFd != -1) {
+        drop.finish();
+    }
+    if (readSize == -1) {//read failed
+        perror("smash error: read failed");
+        return -1;
+    }
+    if (dstFd != -1 && ftruncate(dstFd, offset) == -1) { // trailing holes
+        perror("smash error: ftruncate failed");
+        return -1;
+    }
+    return COPY_CHECKSUMMED;
+}
+
+static std::mutex errorLock;
+
+//cp workers share stderr, so every error is written as one line
+static void printCopyError(const string &path, int err) {
+    std::lock_guard<std::mutex> guard(errorLock);
+    cerr << string("smash error: cp: ") + path + ": " + strerror(err) + "\n";
+}
+
+bool verifyCopy(const char *path, uint32_t expected) {
+    int fd = open(path, O_RDONLY | O_DIRECT);
+    if (fd == -1) { // no O_DIRECT here, drop the cached pages instead
+        fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            printCopyError(path, errno);
+            return false;
+        }
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    void *buffer = mmap(NULL, CHECKSUM_BUF_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); // O_DIRECT aligned
+    if (buffer == MAP_FAILED) {
+        perror("smash error: mmap failed");
+        close(fd);
+        return false;
+    }
+    uint32_t crc = 0;
+    ssize_t readSize;
+    while ((readSize = read(fd, buffer, CHECKSUM_BUF_SIZE)) > 0) {
+        crc = crc32c(crc, buffer, readSize);
+    }
+    int readErrno = errno;
+    munmap(buffer, CHECKSUM_BUF_SIZE);
+    close(fd);
+    if (readSize == -1) {
+        printCopyError(path, readErrno);
+        return false;
+    }
+    if (crc != expected) {
+        cerr << "smash error: cp: " << path << ": verification failed"
+             << endl;
+        return false;
+    }
+    return true;
+}
+
+static string crcString(uint32_t crc) {
+    std::ostringstream str;
+    str << " (crc32c " << std::hex << std::setw(8) << std::setfill('0') << crc
+        << ")";
+    return str.str();
+}
+
+//parses sizes like 4096, 64K, 16M or 1G
+static bool parseSize(const char *str, off_t *size) {
+    char *end;
+    errno = 0;
+    long long value = strtoll(str, &end, 10);
+    if (errno != 0 || end == str || value <= 0) {
+        return false;
+    }
+    int shift = 0;
+    if (*end == 'K' || *end == 'k') {
+        shift = 10;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        shift = 20;
+        end++;
+    } else if (*end == 'G' || *end == 'g') {
+        shift = 30;
+        end++;
+    }
+    if (value > (long long) (OFF_T_MAX >> shift)) { // would not fit an off_t
+        return false;
+    }
+    *size = (off_t) value << shift;
+    return *end == '\0';
+}
+
+//parses a worker count, a plain number from 1 to MAX_THREADS
+static bool parseThreads(const char *str, int *threads) {
+    char *end;
+    errno = 0;
+    long value = strtol(str, &end, 10);
+    if (errno != 0 || end == str || *end != '\0' || value <= 0 ||
+        value > MAX_THREADS) {
+        return false;
+    }
+    *threads = value;
+    return true;
+}
+
+//parses cp [-v] [-r] [-S] [-u] [-j threads] [-b chunk-size] [-n | -D | -k]
+// [-c | -V] src... dst or cp -m src dst..., redirection args end the cp
+// args. -m copies src to every dst, reading it once. -c prints the crc32c
+// of the copied data and -V also re-reads the copy to verify it, neither
+// goes with -u, -j or -D. -u rewrites only the changed blocks of an
+// existing destination. -n copies in windows and drops each one from the
+// page cache once it is written back (the default for background cp), -D
+// uses O_DIRECT and -k keeps the page cache (the default for foreground
+// cp). -S turns zero blocks into holes even if the source isn't sparse
+static bool parseCopyArgs(char *const *args, CopyOptions &options,
+                          vector<const char *> &operands) {
+    options.verbose = false;
+    options.recursive = false;
+    options.threadsGiven = false;
+    options.threads = 1;
+    options.chunkSize = DEFAULT_CHUNK_SIZE;
+    options.cacheMode = CACHE_DEFAULT;
+    options.sparseMode = SPARSE_AUTO;
+    options.incremental = false;
+    options.fanout = false;
+    options.checksum = false;
+    options.verify = false;
+    for (int i = 1; args[i] != NULL && args[i][0] != '>'; i++) {
+        if (strcmp(args[i], "-v") == 0) {
+            options.verbose = true;
+        } else if (strcmp(args[i], "-r") == 0) {
+            options.recursive = true;
+        } else if (strcmp(args[i], "-c") == 0) {
+            options.checksum = true;
+        } else if (strcmp(args[i], "-V") == 0) {
+            options.checksum = true;
+            options.verify = true;
+        } else if (strcmp(args[i], "-m") == 0) {
+            options.fanout = true;
+        } else if (strcmp(args[i], "-u") == 0) {
+            options.incremental = true;
+        } else if (strcmp(args[i], "-S") == 0) {
+            options.sparseMode = SPARSE_ALWAYS;
+        } else if (strcmp(args[i], "-n") == 0) {
+            options.cacheMode = CACHE_DROP;
+        } else if (strcmp(args[i], "-D") == 0) {
+            options.cacheMode = CACHE_DIRECT;
+        } else if (strcmp(args[i], "-k") == 0) {
+            options.cacheMode = CACHE_KEEP;
+        } else if (strcmp(args[i], "-j") == 0) {
+            if (args[i + 1] == NULL ||
+                !parseThreads(args[i + 1], &options.threads)) {
+                return false;
+            }
+            options.threadsGiven = true;
+            i++;
+        } else if (strcmp(args[i], "-b") == 0) {
+            if (args[i + 1] == NULL ||
+                !parseSize(args[i + 1], &options.chunkSize)) {
+                return false;
+            }
+            i++;
+        } else if (args[i][0] == '-' && args[i][1] != '\0') {
+            return false;
+        } else {
+            operands.push_back(args[i]);
+        }
+    }
+    //the checksum is taken over one sequential pass of the buffers it
+    // writes, which an in-place, threaded or O_DIRECT copy doesn't make
+    if (options.checksum && !options.fanout &&
+        (options.incremental || options.threadsGiven ||
+         options.cacheMode == CACHE_DIRECT)) {
+        return false;
+    }
+    return operands.size() >= 2;
+}
+
+//an incremental copy rewrites the destination in place
+static int dstOpenFlags(const CopyOptions &options) {
+    if (options.incremental) {
+        return O_RDWR | O_CREAT;
+    }
+    return O_WRONLY | O_CREAT | O_TRUNC;
+}
+
+//picks the copy strategy for an open regular file. parallel says if
+// the workers may be used, and is set to whether they were. CACHE_DROP
+// copies regular files in ranges, one worker unless parallel, and drops
+// them behind. only CACHE_DIRECT streams through copyUncached
+static int copyContents(int srcFd, int dstFd, const char *dstPath,
+                        const struct stat &srcStat,
+                        const CopyOptions &options, bool *parallel) {
+    if (options.incremental && S_ISREG(srcStat.st_mode)) {
+        *parallel = false;
+        return copyIncremental(srcFd, dstFd, dstPath, srcStat,
+                               options.verbose);
+    }
+    bool direct = options.cacheMode == CACHE_DIRECT;
+    bool sparse = options.sparseMode == SPARSE_ALWAYS ||
+                  (S_ISREG(srcStat.st_mode) &&
+                   srcStat.st_blocks * 512 < srcStat.st_size);
+    *parallel = *parallel && !direct && !sparse &&
+                S_ISREG(srcStat.st_mode) &&
+                srcStat.st_size >= 2 * options.chunkSize;
+    bool drop = options.cacheMode == CACHE_DROP;
+    if ((*parallel || direct || sparse || drop) &&
+        ioctl(dstFd, FICLONE, srcFd) == 0) {
+        addCopied(srcStat.st_size);
+        *parallel = false;
+        return COPY_REFLINK; // cloning beats any number of threads, keeps
+        // the holes and doesn't go through the page cache
+    }
+    if (direct) {
+        return copyUncached(srcFd, dstFd, srcStat.st_size, true);
+    }
+    int strategy;
+    if (sparse) {
+        strategy = copySparse(srcFd, dstFd, srcStat.st_size,
+                              options.sparseMode == SPARSE_ALWAYS, drop);
+    } else if (*parallel) {
+        strategy = copyParallel(srcFd, dstFd, srcStat.st_size, options);
+    } else if (drop && S_ISREG(srcStat.st_mode)) {
+        CopyOptions oneWorker = options;
+        oneWorker.threads = 1;
+        strategy = copyParallel(srcFd, dstFd, srcStat.st_size, oneWorker);
+    } else {
+        strategy = copyFd(srcFd, dstFd);
+        if (drop && strategy != -1) { // not a file, its size isn't known
+            dropCopied(srcFd, dstFd);
+        }
+    }
+    return strategy;
+}
+
+//copies one regular file, returns false on error (printed). a copy of a
+// file onto itself is a successful no-op. with options.checksum the digest
+// of the copied data is set to crc
+static bool copyFile(const char *src, const char *dst,
+                     const CopyOptions &options, uint32_t *crc) {
+    int fds[2];
+    fds[0] = open(src, O_RDONLY);
+    if (fds[0] == -1) {
+        perror("smash error: open failed");
+        return false;
+    }
+    char *path1 = realpath(src, NULL);
+    char *path2 = realpath(dst, NULL);
+    if (path2 != NULL && strcmp(path1, path2) == 0) {
+        free(path1);
+        free(path2);
+        struct stat srcStat;
+        if (options.checksum && fstat(fds[0], &srcStat) == 0) {
+            addTotal(srcStat.st_size);
+            copyChecksummed(fds[0], -1, crc, false, false);
+        }
+        close(fds[0]);
+        return true;
+    }
+    free(path1);
+    free(path2);
+    fds[1] = open(dst, dstOpenFlags(options), 0666);
+    if (fds[1] == -1) {
+        perror("smash error: open failed");
+        close(fds[0]);
+        return false;
+    }
+    struct stat srcStat;
+    if (fstat(fds[0], &srcStat) == -1) {
+        perror("smash error: fstat failed");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    addTotal(srcStat.st_size);
+    bool parallel = false;
+    int strategy;
+    if (options.checksum) {
+        bool holes = options.sparseMode == SPARSE_ALWAYS ||
+                     srcStat.st_blocks * 512 < srcStat.st_size;
+        strategy = copyChecksummed(fds[0], fds[1], crc, holes,
+                                   options.cacheMode == CACHE_DROP);
+    } else {
+        parallel = options.threads > 1;
+        strategy = copyContents(fds[0], fds[1], dst, srcStat, options,
+                                &parallel);
+    }
+    if (options.verify && strategy != -1) {
+        fdatasync(fds[1]);
+    }
+    close(fds[0]);
+    close(fds[1]);
+    if (strategy == -1) {
+        return false;
+    }
+    if (options.verify && !verifyCopy(dst, *crc)) {
+        return false;
+    }
+    if (options.verbose) {
+        cout << "smash: cp: used " << copyStrategyName((COPY_STRATEGY) strategy);
+        if (parallel) {
+            cout << " with " << options.threads << " threads";
+        }
+        cout << endl;
+    }
+    return true;
+}
+
+//one file (or symlink) of a tree or multi-source copy
+typedef struct {
+    string src;
+    string dst;
+    mode_t mode;
+    int source; // index of the cp operand it came from
+} CopyTask;
+
+//walks the dir open at srcDirFd, creating the matching dirs under dstPath
+// ahead of the copies and queueing its files to tasks. the dirs are made
+// writable for the copy and queued to dirs post-order, so their modes can be
+// restored children first once the files are in. closes srcDirFd
+static bool walkTree(int srcDirFd, const string &srcPath,
+                     const string &dstPath, mode_t mode, int source,
+                     vector<CopyTask> &tasks, vector<CopyTask> &dirs) {
+    if (mkdir(dstPath.c_str(), (mode & 07777) | S_IRWXU) == -1 &&
+        errno != EEXIST) {
+        printCopyError(dstPath, errno);
+        close(srcDirFd);
+        return false;
+    }
+    DIR *dir = fdopendir(srcDirFd);
+    if (dir == NULL) {
+        printCopyError(srcPath, errno);
+        close(srcDirFd);
+        return false;
+    }
+    bool success = true;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 ||
+            strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        string childSrc = srcPath + "/" + entry->d_name;
+        string childDst = dstPath + "/" + entry->d_name;
+        struct statx stx;
+        if (statx(dirfd(dir), entry->d_name, AT_SYMLINK_NOFOLLOW,
+                  STATX_TYPE | STATX_MODE | STATX_SIZE, &stx) == -1) {
+            printCopyError(childSrc, errno);
+            success = false;
+            continue;
+        }
+        if (S_ISDIR(stx.stx_mode)) {
+            int childFd = openat(dirfd(dir), entry->d_name,
+                                 O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+            if (childFd == -1) {
+                printCopyError(childSrc, errno);
+                success = false;
+                continue;
+            }
+            if (!walkTree(childFd, childSrc, childDst, stx.stx_mode, source,
+                          tasks, dirs)) {
+                success = false;
+            }
+        } else if (S_ISREG(stx.stx_mode) || S_ISLNK(stx.stx_mode)) {
+            CopyTask task = {childSrc, childDst, stx.stx_mode, source};
+            tasks.push_back(task);
+            if (S_ISREG(stx.stx_mode)) {
+                addTotal(stx.stx_size);
+            }
+        } else {
+            printCopyError(childSrc, ENOTSUP);
+            success = false;
+        }
+    }
+    closedir(dir);
+    CopyTask dirTask = {srcPath, dstPath, mode, source};
+    dirs.push_back(dirTask);
+    return success;
+}
+
+//sets each copied dir to its source mode, dirs is post-order so a parent
+// loses its write bit only after its children are done
+static void restoreDirModes(const vector<CopyTask> &dirs,
+                            vector<char> &failed) {
+    for (unsigned int i = 0; i < dirs.size(); i++) {
+        if (chmod(dirs[i].dst.c_str(), dirs[i].mode & 07777) == -1) {
+            printCopyError(dirs[i].dst, errno);
+            failed[dirs[i].source] = true;
+        }
+    }
+}
+
+static bool copyTask(const CopyTask &task, const CopyOptions &options) {
+    if (S_ISLNK(task.mode)) {
+        char target[PATH_MAX];
+        ssize_t length = readlink(task.src.c_str(), target, PATH_MAX - 1);
+        if (length == -1) {
+            printCopyError(task.src, errno);
+            return false;
+        }
+        target[length] = '\0';
+        unlink(task.dst.c_str());
+        if (symlink(target, task.dst.c_str()) == -1) {
+            printCopyError(task.dst, errno);
+            return false;
+        }
+        return true;
+    }
+    int srcFd = open(task.src.c_str(), O_RDONLY);
+    if (srcFd == -1) {
+        printCopyError(task.src, errno);
+        return false;
+    }
+    int dstFd = open(task.dst.c_str(), dstOpenFlags(options),
+                     task.mode & 07777);
+    if (dstFd == -1) {
+        printCopyError(task.dst, errno);
+        close(srcFd);
+        return false;
+    }
+    struct stat srcStat;
+    bool parallel = false; // the workers are busy with the other files
+    bool success = fstat(srcFd, &srcStat) == 0 &&
+                   copyContents(srcFd, dstFd, task.dst.c_str(), srcStat,
+                                options, &parallel) != -1;
+    close(srcFd);
+    close(dstFd);
+    return success;
+}
+
+//copies the queued files with a pool of workers so many small copies are
+// in flight at once. failed[i] is set if a file of operand i failed
+static void copyTasks(const vector<CopyTask> &tasks, int threads,
+                      const CopyOptions &options, vector<char> &failed) {
+    std::atomic<unsigned int> nextTask(0);
+    //each task's result is written by the one worker that took it, and
+    // read into failed only after the join, as operands share entries
+    vector<char> taskFailed(tasks.size(), false);
+    auto worker = [&]() {
+        unsigned int i;
+        while ((i = nextTask.fetch_add(1)) < tasks.size()) {
+            taskFailed[i] = !copyTask(tasks[i], options);
+        }
+    };
+    vector<std::thread> workers;
+    for (int i = 1; i < threads && (unsigned int) i < tasks.size(); i++) {
+        workers.push_back(std::thread(worker));
+    }
+    worker();
+    for (unsigned int i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+    for (unsigned int i = 0; i < tasks.size(); i++) {
+        if (taskFailed[i]) {
+            failed[tasks[i].source] = true;
+        }
+    }
+}
+
+static string baseName(const string &path) {
+    size_t end = path.find_last_not_of('/');
+    if (end == string::npos) {
+        return "/";
+    }
+    size_t start = path.find_last_of('/', end);
+    return path.substr(start == string::npos ? 0 : start + 1,
+                       end - (start == string::npos ? 0 : start + 1) + 1);
+}
+
+void copyFanout(int srcFd, vector<FanoutTarget> &targets, uint32_t *crc) {
+    vector<char> buffers[2] = {vector<char>(FANOUT_BUF_SIZE),
+                               vector<char>(FANOUT_BUF_SIZE)};
+    std::mutex lock;
+    std::condition_variable changed;
+    long generation = 0; // number of chunks published to the writers
+    unsigned int pending = 0; // writers still writing the current chunk
+    bool done = false;
+    const char *chunk = NULL;
+    ssize_t chunkSize = 0;
+    off_t chunkOffset = 0;
+    auto writer = [&](FanoutTarget &target) {
+        long seen = 0;
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            changed.wait(guard, [&]() { return generation > seen || done; });
+            if (generation == seen) { // done and nothing new
+                break;
+            }
+            seen = generation;
+            const char *data = chunk;
+            ssize_t size = chunkSize;
+            off_t offset = chunkOffset;
+            guard.unlock();
+            ssize_t written = 0;
+            while (target.error == 0 && written < size) {
+                ssize_t writeStatus = pwrite(target.fd, data + written,
+                                             size - written, offset + written);
+                if (writeStatus == -1) {
+                    target.error = errno; // this destination stops here
+                    printCopyError(target.path, errno);
+                } else {
+                    written += writeStatus;
+                }
+            }
+            guard.lock();
+            if (--pending == 0) {
+                changed.notify_all();
+            }
+        }
+    };
+    vector<std::thread> writers;
+    for (unsigned int i = 0; i < targets.size(); i++) {
+        if (targets[i].error == 0) {
+            writers.push_back(std::thread(writer, std::ref(targets[i])));
+        }
+    }
+    //the next chunk is read while the writers write the current one
+    int current = 0;
+    off_t offset = 0;
+    ssize_t readSize;
+    while ((readSize = read(srcFd, buffers[current].data(),
+                            FANOUT_BUF_SIZE)) > 0) {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&]() { return pending == 0; });
+        chunk = buffers[current].data();
+        chunkSize = readSize;
+        chunkOffset = offset;
+        pending = writers.size();
+        generation++;
+        changed.notify_all();
+        guard.unlock();
+        if (crc != NULL) { // while the writers write the same chunk
+            *crc = crc32c(*crc, buffers[current].data(), readSize);
+        }
+        addCopied(readSize);
+        offset += readSize;
+        current ^= 1;
+    }
+    int readErrno = errno;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&]() { return pending == 0; });
+        done = true;
+        changed.notify_all();
+    }
+    for (unsigned int i = 0; i < writers.size(); i++) {
+        writers[i].join();
+    }
+    if (readSize == -1) {//read failed, none of the copies is complete
+        errno = readErrno;
+        perror("smash error: read failed");
+        for (unsigned int i = 0; i < targets.size(); i++) {
+            if (targets[i].error == 0) {
+                targets[i].error = readErrno;
+            }
+        }
+    }
+}
+
+//the exit status of the cp process
+static void cpExit(bool failed) {
+    exit(failed ? 1 : 0);
+}
+
+//cp -m src dst...
+static void cpFanoutMain(const vector<const char *> &operands,
+                         const CopyOptions &options) {
+    const char *src = operands[0];
+    int srcFd = open(src, O_RDONLY);
+    if (srcFd == -1) {
+        perror("smash error: open failed");
+        cpExit(true);
+    }
+    char *srcPath = realpath(src, NULL);
+    vector<FanoutTarget> targets;
+    vector<string> paths;
+    for (unsigned int i = 1; i < operands.size(); i++) {
+        FanoutTarget target = {operands[i], -1, 0};
+        struct stat dstStat;
+        string path = operands[i];
+        if (stat(operands[i], &dstStat) == 0 && S_ISDIR(dstStat.st_mode)) {
+            path += "/" + baseName(src);
+        }
+        char *dstPath = realpath(path.c_str(), NULL);
+        bool sameFile = dstPath != NULL && srcPath != NULL &&
+                        strcmp(srcPath, dstPath) == 0;
+        free(dstPath);
+        if (!sameFile) { // a copy onto the source itself is already done
+            target.fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            if (target.fd == -1) {
+                target.error = errno;
+                printCopyError(path, errno);
+            }
+        }
+        targets.push_back(target);
+        paths.push_back(path);
+    }
+    free(srcPath);
+    bool failed = false;
+    struct stat srcStat;
+    if (fstat(srcFd, &srcStat) == 0) {
+        addTotal(srcStat.st_size);
+    }
+    posix_fadvise(srcFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    uint32_t crc = 0;
+    copyFanout(srcFd, targets, options.checksum ? &crc : NULL);
+    close(srcFd);
+    for (unsigned int i = 0; i < targets.size(); i++) {
+        if (targets[i].fd != -1) {
+            if (options.verify && targets[i].error == 0) {
+                fdatasync(targets[i].fd);
+            }
+            close(targets[i].fd);
+        }
+        if (targets[i].error == 0 && targets[i].fd != -1 && options.verify &&
+            !verifyCopy(paths[i].c_str(), crc)) {
+            failed = true;
+            continue;
+        }
+        if (targets[i].error == 0) {
+            cout << "smash: " << src << " was copied to " << targets[i].path
+                 << (options.checksum ? crcString(crc) : "") << endl;
+        } else {
+            failed = true;
+        }
+    }
+    cpExit(failed);
+}
+
+//true if dst is src or inside it, so walking src would find the copy
+static bool isInside(const char *src, const string &dst) {
+    char *srcPath = realpath(src, NULL);
+    size_t slash = dst.find_last_of('/');
+    string parentDir = slash == string::npos ? "." : dst.substr(0, slash + 1);
+    char *dstParent = realpath(parentDir.c_str(), NULL);
+    bool inside = false;
+    if (srcPath != NULL && dstParent != NULL) {
+        string parent = string(dstParent) + "/";
+        inside = parent.compare(0, strlen(srcPath) + 1,
+                                string(srcPath) + "/") == 0;
+    }
+    free(srcPath);
+    free(dstParent);
+    return inside;
+}
+
+void cpMain(char *const *args, bool isBackground,
+            CopyProgress *sharedProgress) {
+    progress = sharedProgress;
+    CopyOptions options;
+    vector<const char *> operands;
+    if (!parseCopyArgs(args, options, operands)) {
+        cerr << "smash error: cp: invalid arguments" << endl;
+        cpExit(true);
+    }
+    if (options.cacheMode == CACHE_DEFAULT) {
+        options.cacheMode = isBackground ? CACHE_DROP : CACHE_KEEP;
+    }
+    if (options.fanout) {
+        cpFanoutMain(operands, options);
+    }
+    const char *dst = operands.back();
+    operands.pop_back();
+    struct stat dstStat;
+    bool dstIsDir = stat(dst, &dstStat) == 0 && S_ISDIR(dstStat.st_mode);
+    if (operands.size() > 1 && !dstIsDir) {
+        cerr << "smash error: cp: " << dst << " is not a directory" << endl;
+        cpExit(true);
+    }
+    struct stat srcStat;
+    if (operands.size() == 1 &&
+        (stat(operands[0], &srcStat) == -1 || !S_ISDIR(srcStat.st_mode))) {
+        string target = dstIsDir ? string(dst) + "/" + baseName(operands[0])
+                                 : string(dst);
+        uint32_t crc = 0;
+        bool copied = copyFile(operands[0], target.c_str(), options, &crc);
+        if (copied) { //plain cp src dst
+            cout << "smash: " << operands[0] << " was copied to " << dst
+                 << (options.checksum ? crcString(crc) : "") << endl;
+        }
+        cpExit(!copied);
+    }
+    if (options.checksum) { // digests are printed for single files only
+        cerr << "smash error: cp: invalid arguments" << endl;
+        cpExit(true);
+    }
+    vector<CopyTask> tasks;
+    vector<CopyTask> dirs;
+    vector<char> failed(operands.size(), false);
+    for (unsigned int i = 0; i < operands.size(); i++) {
+        string target = dstIsDir ? string(dst) + "/" + baseName(operands[i])
+                                 : string(dst);
+        if (stat(operands[i], &srcStat) == -1) {
+            printCopyError(operands[i], errno);
+            failed[i] = true;
+        } else if (!S_ISDIR(srcStat.st_mode)) {
+            CopyTask task = {operands[i], target, srcStat.st_mode, (int) i};
+            tasks.push_back(task);
+            addTotal(srcStat.st_size);
+        } else if (!options.recursive) {
+            cerr << "smash error: cp: " << operands[i] << " is a directory"
+                 << endl;
+            failed[i] = true;
+        } else if (isInside(operands[i], target)) {
+            cerr << "smash error: cp: cannot copy " << operands[i]
+                 << " into itself" << endl;
+            failed[i] = true;
+        } else {
+            int dirFd = open(operands[i], O_RDONLY | O_DIRECTORY);
+            if (dirFd == -1 || !walkTree(dirFd, operands[i], target,
+                                         srcStat.st_mode, i, tasks, dirs)) {
+                if (dirFd == -1) {
+                    printCopyError(operands[i], errno);
+                }
+                failed[i] = true;
+            }
+        }
+    }
+    copyTasks(tasks, options.threadsGiven ? options.threads :
+                     DEFAULT_TREE_THREADS, options, failed);
+    restoreDirModes(dirs, failed);
+    bool anyFailed = false;
+    for (unsigned int i = 0; i < operands.size(); i++) {
+        if (!failed[i]) {
+            cout << "smash: " << operands[i] << " was copied to " << dst
+                 << endl;
+        }
+        anyFailed = anyFailed || failed[i];
+    }
+    cpExit(anyFailed);
+}
@@ -0,0 +1,111 @@
+#ifndef SMASH_COPY_H_
+#define SMASH_COPY_H_
+
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+typedef enum {
+    COPY_REFLINK, COPY_FILE_RANGE, COPY_SENDFILE, COPY_BUFFERED, COPY_NOTHING,
+    COPY_UNCACHED, COPY_DIRECT, COPY_SPARSE, COPY_INCREMENTAL,
+    COPY_CHECKSUMMED
+} COPY_STRATEGY;
+
+typedef enum {
+    CACHE_DEFAULT, CACHE_KEEP, CACHE_DROP, CACHE_DIRECT
+} CACHE_MODE;
+
+typedef enum {
+    SPARSE_AUTO, SPARSE_ALWAYS
+} SPARSE_MODE;
+
+typedef struct {
+    bool verbose;
+    bool recursive;
+    bool threadsGiven;
+    int threads;
+    off_t chunkSize;
+    CACHE_MODE cacheMode;
+    SPARSE_MODE sparseMode;
+    bool incremental;
+    bool fanout;
+    bool checksum;
+    bool verify;
+} CopyOptions;
+
+//one destination of a fan-out copy, error is the errno it failed with
+typedef struct {
+    const char *path;
+    int fd;
+    int error;
+} FanoutTarget;
+
+//how far a cp process got, in memory shared with smash so jobs can show
+// it. the cp process only adds to it with relaxed atomics, no syscalls
+typedef struct {
+    std::atomic<uint64_t> total; // bytes to copy, grows while a tree is walked
+    std::atomic<uint64_t> copied;
+} CopyProgress;
+
+//maps a CopyProgress shared with the processes forked after it, NULL if
+// mmap failed
+CopyProgress *createCopyProgress();
+
+void destroyCopyProgress(CopyProgress *progress);
+
+const char *copyStrategyName(COPY_STRATEGY strategy);
+
+//copies srcFd to dstFd from their current offsets to the end of srcFd,
+// trying reflink, copy_file_range and sendfile before the buffered loop.
+// returns the strategy that finished the copy, or -1 on error (printed)
+int copyFd(int srcFd, int dstFd);
+
+//copies the whole of srcFd to dstFd with options.threads workers, each
+// taking options.chunkSize ranges in turn. dstFd is pre-sized first. with
+// CACHE_DROP each worker drops its ranges from the page cache behind it.
+// returns the strategy used for the ranges, or -1 on error (printed)
+int copyParallel(int srcFd, int dstFd, off_t size, const CopyOptions &options);
+
+//copies the whole of srcFd to dstFd without leaving either in the page
+// cache, with buffers sized from the files. with direct, O_DIRECT is used
+// where the file systems allow it. returns the strategy or -1 (printed)
+int copyUncached(int srcFd, int dstFd, off_t size, bool direct);
+
+//copies only the data extents of srcFd (found with SEEK_DATA/SEEK_HOLE),
+// the holes are recreated in dstFd. with detectZeros, zero blocks in the
+// data become holes too. with dropBehind the copied data is dropped from
+// the page cache as it goes. returns the strategy or -1 (printed)
+int copySparse(int srcFd, int dstFd, off_t size, bool detectZeros,
+               bool dropBehind);
+
+//compares srcFd and dstFd block by block and rewrites only the blocks that
+// differ. progress is checkpointed next to dstPath, so an interrupted copy
+// of the same source resumes from the last verified offset. returns the
+// strategy or -1 (printed)
+int copyIncremental(int srcFd, int dstFd, const char *dstPath,
+                    const struct stat &srcStat, bool verbose);
+
+//reads srcFd once, chunk by chunk, and writes every chunk to all the
+// targets concurrently. a target that fails is reported and dropped while
+// the others go on. if crc isn't NULL it is set to the crc32c of the data
+void copyFanout(int srcFd, std::vector<FanoutTarget> &targets, uint32_t *crc);
+
+//copies srcFd to dstFd computing the crc32c of the buffers as they are
+// written, so the data is read once. with holes, zero blocks are left as
+// holes. dstFd is truncated to the copied size. with dropBehind the copied
+// data is dropped from the page cache as it goes. with dstFd -1 it only
+// checksums. returns the strategy or -1 (printed)
+int copyChecksummed(int srcFd, int dstFd, uint32_t *crc, bool holes,
+                    bool dropBehind);
+
+//re-reads path bypassing the page cache and compares its crc32c
+bool verifyCopy(const char *path, uint32_t expected);
+
+//the cp process body, never returns. background cp jobs don't keep the
+// copied files in the page cache unless asked to. the bytes copied are
+// added to progress if it isn't NULL
+void cpMain(char *const *args, bool isBackground, CopyProgress *progress);
+
+#endif //SMASH_COPY_H_
@@ -0,0 +1,131 @@
+#include <spawn.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "launcher.h"
+#include "timers.h"
+
+extern char **environ;
+
+LaunchCounter spawnCounter = {0, 0, 0, 0};
+LaunchCounter forkCounter = {0, 0, 0, 0};
+
+//signals smash catches, the launched programs should get them with the
+// default action
+const int RESET_SIGNALS[] = {SIGINT, SIGTSTP, SIGCONT, SIGALRM, SIGCHLD};
+
+static void countLaunch(LaunchCounter *counter, long long startNs,
+                        bool failed) {
+    long long elapsed = monotonicNs() - startNs;
+    counter->count++;
+    if (failed) {
+        counter->failed++;
+    }
+    counter->totalNs += elapsed;
+    if (elapsed > counter->maxNs) {
+        counter->maxNs = elapsed;
+    }
+}
+
+LaunchSpec::~LaunchSpec() {
+    for (unsigned int i = 0; i < openedFds.size(); i++) {
+        close(openedFds[i]);
+    }
+}
+
+void LaunchSpec::dupFd(int fd, int target) {
+    FdAction action = {fd, target};
+    actions.push_back(action);
+}
+
+void LaunchSpec::closeFd(int fd) {
+    FdAction action = {fd, -1};
+    actions.push_back(action);
+}
+
+bool LaunchSpec::redirectFd(int target, const char *path, int flags) {
+    int fd = open(path, flags | O_CLOEXEC, 0666);
+    if (fd == -1) {
+        perror("smash error: open failed");
+        return false;
+    }
+    openedFds.push_back(fd);
+    dupFd(fd, target);
+    closeFd(fd); // forked children don't exec, so O_CLOEXEC won't close it
+    return true;
+}
+
+pid_t launchProgram(const LaunchSpec &spec, const char *path,
+                    char *const *argv, bool searchPath) {
+    long long start = monotonicNs();
+    fflush(stdout); // smash's output so far comes before the program's
+    posix_spawn_file_actions_t fileActions;
+    posix_spawnattr_t attr;
+    sigset_t defaultSignals, emptyMask;
+    posix_spawn_file_actions_init(&fileActions);
+    posix_spawnattr_init(&attr);
+    const std::vector<LaunchSpec::FdAction> &actions = spec.getActions();
+    for (unsigned int i = 0; i < actions.size(); i++) {
+        if (actions[i].target == -1) {
+            posix_spawn_file_actions_addclose(&fileActions, actions[i].fd);
+        } else {
+            posix_spawn_file_actions_adddup2(&fileActions, actions[i].fd,
+                                             actions[i].target);
+        }
+    }
+    sigemptyset(&defaultSignals);
+    for (unsigned int i = 0; i < sizeof(RESET_SIGNALS) / sizeof(int); i++) {
+        sigaddset(&defaultSignals, RESET_SIGNALS[i]);
+    }
+    sigemptyset(&emptyMask);
+    posix_spawnattr_setpgroup(&attr, spec.getGroup());
+    posix_spawnattr_setsigdefault(&attr, &defaultSignals);
+    posix_spawnattr_setsigmask(&attr, &emptyMask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP |
+                                    POSIX_SPAWN_SETSIGDEF |
+                                    POSIX_SPAWN_SETSIGMASK);
+    pid_t pid;
+    int res;
+    if (searchPath) {
+        res = posix_spawnp(&pid, path, &fileActions, &attr, argv, environ);
+    } else {
+        res = posix_spawn(&pid, path, &fileActions, &attr, argv, environ);
+    }
+    posix_spawn_file_actions_destroy(&fileActions);
+    posix_spawnattr_destroy(&attr);
+    countLaunch(&spawnCounter, start, res != 0);
+    if (res != 0) {
+        errno = res;
+        return -1;
+    }
+    return pid;
+}
+
+pid_t launchFork(const LaunchSpec &spec) {
+    long long start = monotonicNs();
+    fflush(stdout); // or the child would write the buffered output again
+    pid_t pid = fork();
+    if (pid != 0) { // parent
+        if (pid != -1) {
+            setpgid(pid, spec.getGroup() == NEW_PGRP ? pid : spec.getGroup());
+        }
+        countLaunch(&forkCounter, start, pid == -1);
+        return pid;
+    }
+    setpgid(0, spec.getGroup());
+    sigset_t none; // smash blocks the signals it reads from its signalfd
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+    const std::vector<LaunchSpec::FdAction> &actions = spec.getActions();
+    for (unsigned int i = 0; i < actions.size(); i++) {
+        if (actions[i].target == -1) {
+            close(actions[i].fd);
+        } else if (dup2(actions[i].fd, actions[i].target) == -1) {
+            perror("smash error: dup failed");
+            exit(0);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef SMASH_LAUNCHER_H_
+#define SMASH_LAUNCHER_H_
+
+#include <vector>
+#include <unistd.h>
+
+#define NEW_PGRP (0)
+
+//how the launched child should look like: its process group and the fds
+// it gets. files are opened by the parent so open errors are reported
+// before anything is launched
+class LaunchSpec {
+public:
+    struct FdAction {
+        int fd;
+        int target; // -1 means close fd in the child
+    };
+
+private:
+    pid_t pgid;
+    std::vector<FdAction> actions;
+    std::vector<int> openedFds;
+
+public:
+    LaunchSpec() : pgid(NEW_PGRP), actions(), openedFds() {
+    };
+
+    LaunchSpec(LaunchSpec const &) = delete;
+
+    void operator=(LaunchSpec const &) = delete;
+
+    ~LaunchSpec();
+
+    void setGroup(pid_t group) {
+        pgid = group;
+    }
+
+    pid_t getGroup() const {
+        return pgid;
+    }
+
+    //fd becomes target in the child
+    void dupFd(int fd, int target);
+
+    void closeFd(int fd);
+
+    //opens path in the parent and makes it target in the child
+    bool redirectFd(int target, const char *path, int flags);
+
+    const std::vector<FdAction> &getActions() const {
+        return actions;
+    }
+};
+
+typedef struct {
+    unsigned long count;
+    unsigned long failed;
+    long long totalNs;
+    long long maxNs;
+} LaunchCounter;
+
+extern LaunchCounter spawnCounter;
+extern LaunchCounter forkCounter;
+
+//posix_spawn (vfork based, no page tables copy) of a program, returns the
+// child pid or -1 with errno set
+pid_t launchProgram(const LaunchSpec &spec, const char *path,
+                    char *const *argv, bool searchPath);
+
+//fork for children that run smash code (cp, pipe and timeout processes),
+// the spec is applied in the child. returns like fork()
+pid_t launchFork(const LaunchSpec &spec);
+
+#endif //SMASH_LAUNCHER_H_
@@ -0,0 +1,254 @@
+#include <iostream>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "parallel.h"
+#include "Commands.h"
+#include "status.h"
+
+using std::string;
+using std::vector;
+using std::cerr;
+using std::endl;
+
+ParallelProgress *createParallelProgress() {
+    void *shared = mmap(NULL, sizeof(ParallelProgress),
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                        -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("smash error: mmap failed");
+        return NULL;
+    }
+    ParallelProgress *created = new(shared) ParallelProgress;
+    created->done = 0;
+    created->running = 0;
+    created->failed = 0;
+    return created;
+}
+
+void destroyParallelProgress(ParallelProgress *progress) {
+    if (progress != NULL) {
+        munmap(progress, sizeof(ParallelProgress));
+    }
+}
+
+bool parseParallelArgs(char *const *args, ParallelOptions &options) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    options.jobs = cpus > 0 ? cpus : 1;
+    options.cmdWords.clear();
+    options.args.clear();
+    options.argFile = NULL;
+    int i = 1;
+    if (args[i] != NULL && strcmp(args[i], "-j") == 0) {
+        if (args[i + 1] == NULL) {
+            return false;
+        }
+        char *end;
+        errno = 0;
+        long jobs = strtol(args[i + 1], &end, 10);
+        if (*end != '\0' || errno != 0 || jobs <= 0) {
+            return false;
+        }
+        options.jobs = jobs;
+        i += 2;
+    }
+    for (; args[i] != NULL && args[i][0] != '>'; i++) {
+        if (strcmp(args[i], ":::") == 0 || strcmp(args[i], "::::") == 0) {
+            break;
+        }
+        options.cmdWords.push_back(args[i]);
+    }
+    if (options.cmdWords.empty() || args[i] == NULL || args[i][0] == '>') {
+        return false;
+    }
+    if (strcmp(args[i], "::::") == 0) {
+        options.argFile = args[i + 1] != NULL && args[i + 1][0] != '>' ?
+                          args[i + 1] : "-";
+        int after = args[i + 1] != NULL && args[i + 1][0] != '>' ? 2 : 1;
+        return args[i + after] == NULL || args[i + after][0] == '>';
+    }
+    for (i++; args[i] != NULL && args[i][0] != '>'; i++) {
+        options.args.push_back(args[i]);
+    }
+    return true;
+}
+
+//word with every {} replaced by arg, false if it has none
+static bool substitute(const string &word, const string &arg, string &out) {
+    size_t found = word.find("{}");
+    if (found == string::npos) {
+        out = word;
+        return false;
+    }
+    out.clear();
+    size_t start = 0;
+    while (found != string::npos) {
+        out.append(word, start, found - start);
+        out += arg;
+        start = found + 2;
+        found = word.find("{}", start);
+    }
+    out.append(word, start, string::npos);
+    return true;
+}
+
+//the words of the cmd of one arg. the arg stays within the words its {}
+// were in, or is one more word
+static void expand(const vector<string> &cmdWords, const string &arg,
+                   vector<string> &words) {
+    words.resize(cmdWords.size());
+    bool substituted = false;
+    for (unsigned int i = 0; i < cmdWords.size(); i++) {
+        substituted = substitute(cmdWords[i], arg, words[i]) || substituted;
+    }
+    if (!substituted) {
+        words.push_back(arg);
+    }
+}
+
+//arg as one word of a bash cmd line, in single quotes
+static string shellQuote(const string &arg) {
+    string quoted = "'";
+    for (unsigned int i = 0; i < arg.size(); i++) {
+        if (arg[i] == '\'') {
+            quoted += "'\\''";
+        } else {
+            quoted += arg[i];
+        }
+    }
+    return quoted + "'";
+}
+
+//true if the cmd itself (not its args) needs bash to run
+static bool templateNeedsShell(const vector<string> &cmdWords) {
+    vector<string> words;
+    expand(cmdWords, "", words); // {} isn't shell syntax here
+    if (words[0].empty()) { // the arg is the program
+        words[0] = "true";
+    }
+    vector<char *> argv;
+    for (unsigned int i = 0; i < words.size(); i++) {
+        argv.push_back(&words[i][0]);
+    }
+    argv.push_back(NULL);
+    return needsShell(argv.data());
+}
+
+//launches the cmd of one arg. its words are the argv of the program if
+// it can run without bash. otherwise the arg is quoted into a bash cmd
+// line, so it is still one word that bash doesn't interpret
+static pid_t launchArg(const ParallelOptions &options, bool useShell,
+                       PathCache *paths, const string &arg) {
+    LaunchSpec spec;
+    spec.setGroup(getpgrp()); // signalled with the supervisor
+    vector<string> words;
+    string path;
+    if (!useShell) {
+        expand(options.cmdWords, arg, words);
+        if (paths->resolve(words[0].c_str(), path)) {
+            vector<char *> argv;
+            for (unsigned int i = 0; i < words.size(); i++) {
+                argv.push_back(&words[i][0]);
+            }
+            argv.push_back(NULL);
+            pid_t pid = launchProgram(spec, path.c_str(), argv.data(), false);
+            if (pid != -1 || (errno != ENOENT && errno != ENOEXEC)) {
+                return pid;
+            }
+        } // not a program bash can't run either, let it report that
+    }
+    expand(options.cmdWords, shellQuote(arg), words);
+    string line;
+    for (unsigned int i = 0; i < words.size(); i++) {
+        line += (i == 0 ? "" : " ") + words[i];
+    }
+    char bash[] = "/bin/bash", cOption[] = "-c";
+    char *argv[] = {bash, cOption, &line[0], NULL};
+    return launchProgram(spec, bash, argv, false);
+}
+
+//the args are read from the file as they are needed, one per line
+static bool nextArg(const ParallelOptions &options, FILE *argFile,
+                    size_t *index, string &arg) {
+    if (argFile == NULL) {
+        if (*index == options.args.size()) {
+            return false;
+        }
+        arg = options.args[(*index)++];
+        return true;
+    }
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    while ((length = getline(&line, &capacity, argFile)) != -1) {
+        if (length > 0 && line[length - 1] == '\n') {
+            line[--length] = '\0';
+        }
+        if (length > 0) { // empty lines are skipped
+            arg = line;
+            free(line);
+            return true;
+        }
+    }
+    free(line);
+    return false;
+}
+
+void parallelMain(const ParallelOptions &options, PathCache *paths,
+                  ParallelProgress *progress) {
+    FILE *argFile = NULL;
+    if (options.argFile != NULL) {
+        argFile = strcmp(options.argFile, "-") == 0 ? stdin :
+                  fopen(options.argFile, "r");
+        if (argFile == NULL) {
+            perror("smash error: open failed");
+            exit(1);
+        }
+    }
+    size_t index = 0;
+    unsigned long running = 0;
+    bool failed = false;
+    bool useShell = templateNeedsShell(options.cmdWords);
+    string arg;
+    while (true) {
+        //refill the free slots, then wait for the next child to exit
+        while (running < options.jobs &&
+               nextArg(options, argFile, &index, arg)) {
+            if (launchArg(options, useShell, paths, arg) == -1) {
+                perror("smash error: parallel: launch failed");
+                progress->failed++;
+                failed = true;
+                continue;
+            }
+            running++;
+            progress->running++;
+        }
+        if (running == 0) {
+            break;
+        }
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("smash error: waitpid failed");
+            failed = true;
+            break;
+        }
+        running--;
+        progress->running--;
+        if (exitCode(status) == 0) {
+            progress->done++;
+        } else {
+            progress->failed++;
+            failed = true;
+        }
+    }
+    exit(failed ? 1 : 0);
+}
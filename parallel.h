@@ -0,0 +1,43 @@
+#ifndef SMASH_PARALLEL_H_
+#define SMASH_PARALLEL_H_
+
+#include <vector>
+#include <string>
+#include <atomic>
+
+class PathCache;
+
+//what a parallel supervisor got to, in memory shared with smash so jobs can
+// show it. only the supervisor writes it
+typedef struct {
+    std::atomic<unsigned long> done; // exited with status 0
+    std::atomic<unsigned long> running;
+    std::atomic<unsigned long> failed; // exited otherwise or didn't launch
+} ParallelProgress;
+
+//parallel [-j N] cmd... ::: arg... or :::: file ('-' for stdin). every
+// {} in cmd is replaced by the arg, or the arg is appended if there is no
+// {}. the arg is never split or interpreted by a shell
+typedef struct {
+    unsigned long jobs; // children in flight, the online cpus by default
+    std::vector<std::string> cmdWords;
+    std::vector<std::string> args;
+    const char *argFile; // NULL if the args were given after :::
+} ParallelOptions;
+
+//maps a ParallelProgress shared with the processes forked after it, NULL if
+// mmap failed
+ParallelProgress *createParallelProgress();
+
+void destroyParallelProgress(ParallelProgress *progress);
+
+//false if the args are invalid
+bool parseParallelArgs(char *const *args, ParallelOptions &options);
+
+//the supervisor process, runs the cmds in its process group, N at a time,
+// so they are signalled with it. never returns, exits with 1 if a cmd
+// failed
+void parallelMain(const ParallelOptions &options, PathCache *paths,
+                  ParallelProgress *progress);
+
+#endif //SMASH_PARALLEL_H_
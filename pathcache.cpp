@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pathcache.h"
+#include "timers.h"
+
+using std::string;
+
+static struct timespec dirMtime(const string &dir) {
+    struct stat info;
+    if (stat(dir.c_str(), &info) == -1) {
+        struct timespec none = {0, 0};
+        return none;
+    }
+    return info.st_mtim;
+}
+
+static bool sameTime(const struct timespec &a, const struct timespec &b) {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+void PathCache::validate() {
+    long long now = monotonicNs();
+    const char *var = getenv("PATH");
+    string current = var != NULL ? var : DEFAULT_PATH;
+    if (lastCheck == 0 || current != pathVar) {
+        pathVar = current;
+        dirs.clear();
+        relative = false;
+        size_t start = 0;
+        while (true) {
+            size_t colon = pathVar.find(':', start);
+            string dir = pathVar.substr(start, colon == string::npos ?
+                                               string::npos : colon - start);
+            if (dir.empty()) { // an empty dir is the cwd
+                dir = ".";
+            }
+            if (dir[0] != '/') {
+                relative = true;
+            }
+            Dir entry = {dir, dirMtime(dir)};
+            dirs.push_back(entry);
+            if (colon == string::npos) {
+                break;
+            }
+            start = colon + 1;
+        }
+        entries.clear();
+        lastCheck = now;
+        return;
+    }
+    if (now - lastCheck < PATH_CHECK_NS) {
+        return;
+    }
+    lastCheck = now;
+    unsigned int changed = dirs.size();
+    for (unsigned int i = 0; i < dirs.size(); i++) {
+        struct timespec mtime = dirMtime(dirs[i].path);
+        if (!sameTime(mtime, dirs[i].mtime)) {
+            dirs[i].mtime = mtime;
+            if (changed == dirs.size()) {
+                changed = i;
+            }
+        }
+    }
+    if (changed == dirs.size()) {
+        return;
+    }
+    for (auto iter = entries.begin(); iter != entries.end();) {
+        if (iter->second.dir >= changed) { // the misses too
+            iter = entries.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+PathCache::Entry PathCache::search(const char *name) const {
+    for (unsigned int i = 0; i < dirs.size(); i++) {
+        string candidate = dirs[i].path + "/" + name;
+        struct stat info;
+        if (stat(candidate.c_str(), &info) == 0 && S_ISREG(info.st_mode) &&
+            access(candidate.c_str(), X_OK) == 0) {
+            Entry found = {candidate, i, 0};
+            return found;
+        }
+    }
+    Entry missing = {"", (unsigned int) dirs.size(), 0};
+    return missing;
+}
+
+bool PathCache::resolve(const char *name, string &path) {
+    if (strchr(name, '/') != NULL) {
+        path = name;
+        return true;
+    }
+    validate();
+    if (relative) { // can't be cached, the cwd changes
+        missCount++;
+        path = search(name).path;
+        return !path.empty();
+    }
+    auto found = entries.find(name);
+    if (found != entries.end()) {
+        hitCount++;
+        found->second.hits++;
+        path = found->second.path;
+    } else {
+        missCount++;
+        Entry entry = search(name);
+        entry.hits = 1;
+        path = entry.path;
+        entries[name] = entry;
+    }
+    return !path.empty();
+}
+
+bool PathCache::locate(const char *name, string &path, bool *hashed) {
+    *hashed = false;
+    if (strchr(name, '/') != NULL) {
+        path = name;
+        return access(name, X_OK) == 0;
+    }
+    validate();
+    auto found = entries.find(name);
+    if (!relative && found != entries.end() && !found->second.path.empty()) {
+        *hashed = true;
+        path = found->second.path;
+    } else {
+        path = search(name).path;
+    }
+    return !path.empty();
+}
+
+bool PathCache::prewarm(const char *name) {
+    if (strchr(name, '/') != NULL) {
+        return access(name, X_OK) == 0;
+    }
+    validate();
+    if (relative) {
+        return !search(name).path.empty();
+    }
+    auto found = entries.find(name);
+    if (found != entries.end() && !found->second.path.empty()) {
+        return true;
+    }
+    Entry entry = search(name);
+    if (entry.path.empty()) {
+        return false;
+    }
+    entries[name] = entry;
+    return true;
+}
+
+void PathCache::forget(const char *name) {
+    entries.erase(name);
+}
@@ -0,0 +1,88 @@
+#ifndef SMASH_PATHCACHE_H_
+#define SMASH_PATHCACHE_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <time.h>
+
+#define PATH_CHECK_NS (100000000LL) // how often PATH dirs are checked, 100ms
+#define DEFAULT_PATH "/bin:/usr/bin" // what posix_spawnp uses without PATH
+
+//where the programs run without bash were found in PATH, filled lazily.
+// a changed PATH drops everything. a PATH dir whose mtime changed (a
+// program was added or removed) drops what was found in it and in the
+// dirs after it, which it may shadow now. the mtimes are checked at most
+// every PATH_CHECK_NS, a program removed meanwhile fails to launch and
+// is looked up again by the caller (forget)
+class PathCache {
+public:
+    struct Entry {
+        std::string path; // empty if name isn't in PATH
+        unsigned int dir; // index in dirs, dirs.size() if not found
+        unsigned long hits;
+    };
+
+private:
+    struct Dir {
+        std::string path;
+        struct timespec mtime; // zero if it doesn't exist
+    };
+
+    std::string pathVar;
+    std::vector<Dir> dirs;
+    bool relative; // PATH has a relative dir, results depend on the cwd
+    long long lastCheck;
+    std::unordered_map<std::string, Entry> entries;
+    unsigned long hitCount;
+    unsigned long missCount;
+
+    //re-reads PATH and the mtimes of its dirs if it is time to
+    void validate();
+
+    //searches PATH for name without the cache
+    Entry search(const char *name) const;
+
+public:
+    PathCache() : pathVar(), dirs(), relative(false), lastCheck(0),
+                  entries(), hitCount(0), missCount(0) {
+    };
+
+    ~PathCache() = default;
+
+    PathCache(const PathCache &) = delete;
+
+    void operator=(const PathCache &) = delete;
+
+    //the path to run name from, false if it isn't in PATH. a name with '/'
+    // is its own path. counts a hit or a miss and remembers the result
+    bool resolve(const char *name, std::string &path);
+
+    //like resolve, but doesn't count or remember. hashed tells if the
+    // result came from the cache
+    bool locate(const char *name, std::string &path, bool *hashed);
+
+    //looks name up ahead of its first launch, false if it isn't in PATH
+    bool prewarm(const char *name);
+
+    //name didn't launch from the path it was resolved to
+    void forget(const char *name);
+
+    void reset() {
+        entries.clear();
+    }
+
+    const std::unordered_map<std::string, Entry> &getEntries() const {
+        return entries;
+    }
+
+    unsigned long getHits() const {
+        return hitCount;
+    }
+
+    unsigned long getMisses() const {
+        return missCount;
+    }
+};
+
+#endif //SMASH_PATHCACHE_H_
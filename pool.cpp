@@ -0,0 +1,67 @@
+#include <stdlib.h>
+#include <new>
+#include "pool.h"
+
+static ObjectPool *pools = NULL; // zero initialized before any pool
+
+//a free object holds the next free one, so every object must fit a
+// pointer and keep the alignment new gives
+static size_t alignedSize(size_t size) {
+    const size_t align = alignof(max_align_t);
+    if (size < sizeof(void *)) {
+        size = sizeof(void *);
+    }
+    return (size + align - 1) / align * align;
+}
+
+ObjectPool::ObjectPool(const char *name, size_t objectSize) :
+        name(name), objectSize(alignedSize(objectSize)), freeList(NULL),
+        slabs(), live(0), peak(0), next(pools) {
+    pools = this;
+}
+
+const ObjectPool *ObjectPool::first() {
+    return pools;
+}
+
+void ObjectPool::addSlab() {
+    char *slab = (char *) malloc(objectSize * POOL_SLAB_OBJECTS);
+    if (slab == NULL) {
+        throw std::bad_alloc();
+    }
+    slabs.push_back(slab);
+    for (int i = POOL_SLAB_OBJECTS - 1; i >= 0; i--) { // first object on top
+        void *object = slab + i * objectSize;
+        *(void **) object = freeList;
+        freeList = object;
+    }
+}
+
+void *ObjectPool::allocate(size_t size) {
+    if (alignedSize(size) != objectSize) {
+        return ::operator new(size);
+    }
+    if (freeList == NULL) {
+        addSlab();
+    }
+    void *object = freeList;
+    freeList = *(void **) object;
+    live++;
+    if (live > peak) {
+        peak = live;
+    }
+    return object;
+}
+
+void ObjectPool::release(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return;
+    }
+    if (alignedSize(size) != objectSize) {
+        ::operator delete(ptr);
+        return;
+    }
+    *(void **) ptr = freeList;
+    freeList = ptr;
+    live--;
+}
@@ -0,0 +1,78 @@
+#ifndef SMASH_POOL_H_
+#define SMASH_POOL_H_
+
+#include <vector>
+#include <stddef.h>
+
+#define POOL_SLAB_OBJECTS (16) // objects carved from every slab
+
+//fixed size objects carved from slabs that are never given back, a freed
+// object goes to the free list and is reused first. so memory only grows
+// to the peak of live objects. the counters are shown by stats
+class ObjectPool {
+    const char *name;
+    size_t objectSize;
+    void *freeList;
+    std::vector<void *> slabs;
+    unsigned long live;
+    unsigned long peak;
+    ObjectPool *next; // every pool, for stats
+
+    void addSlab();
+
+public:
+    ObjectPool(const char *name, size_t objectSize);
+
+    ~ObjectPool() = default;
+
+    ObjectPool(const ObjectPool &) = delete;
+
+    void operator=(const ObjectPool &) = delete;
+
+    //size other than the pool's (a class that didn't declare its own pool)
+    // goes to the heap. throws std::bad_alloc like new
+    void *allocate(size_t size);
+
+    void release(void *ptr, size_t size);
+
+    const char *getName() const {
+        return name;
+    }
+
+    unsigned long getLive() const {
+        return live;
+    }
+
+    unsigned long getPeak() const {
+        return peak;
+    }
+
+    unsigned long getCapacity() const {
+        return slabs.size() * POOL_SLAB_OBJECTS;
+    }
+
+    const ObjectPool *getNext() const {
+        return next;
+    }
+
+    static const ObjectPool *first();
+};
+
+//put in the class body of every concrete class whose objects come from a
+// pool, and DEFINE_POOL(Class) in its .cpp. the destructor must be virtual
+// when the object is deleted through a base pointer, so the sized delete
+// gets the size of the real class
+#define POOLED \
+public: \
+    static void *operator new(size_t size) { \
+        return pool.allocate(size); \
+    } \
+    static void operator delete(void *ptr, size_t size) { \
+        pool.release(ptr, size); \
+    } \
+private: \
+    static ObjectPool pool;
+
+#define DEFINE_POOL(Class) ObjectPool Class::pool(#Class, sizeof(Class));
+
+#endif //SMASH_POOL_H_
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "procstat.h"
+#include "timers.h"
+
+static long long bootNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    return now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+ProcSampler::ProcSampler() : tracked(), sweep(0), openFds(0) {
+    ticksPerSec = sysconf(_SC_CLK_TCK);
+    pageKb = sysconf(_SC_PAGESIZE) / 1024;
+    struct rlimit limit;
+    maxOpenFds = 0;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) { // half is left to smash
+        maxOpenFds = limit.rlim_cur == RLIM_INFINITY ? 1 << 20 :
+                     limit.rlim_cur / 2;
+    }
+}
+
+ProcSampler::~ProcSampler() {
+    for (auto iter = tracked.begin(); iter != tracked.end(); ++iter) {
+        untrack(iter->second);
+    }
+}
+
+void ProcSampler::untrack(Tracked &proc) {
+    int *fds[] = {&proc.statFd, &proc.statmFd, &proc.ioFd, &proc.childrenFd};
+    for (int i = 0; i < 4; i++) {
+        if (*fds[i] != -1) {
+            close(*fds[i]);
+            *fds[i] = -1;
+            openFds--;
+        }
+    }
+}
+
+void ProcSampler::endSweep() {
+    for (auto iter = tracked.begin(); iter != tracked.end();) {
+        if (iter->second.sweep != sweep) {
+            untrack(iter->second);
+            iter = tracked.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+bool ProcSampler::readProc(int &fd, pid_t pid, const char *name, char *buf) {
+    int readFd = fd;
+    if (readFd == -1) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/%s", (int) pid, name);
+        readFd = open(path, O_RDONLY | O_CLOEXEC);
+        if (readFd == -1) {
+            buf[0] = '\0';
+            return errno != ENOENT && errno != ESRCH; // gone, or just no access
+        }
+        if (openFds < maxOpenFds) {
+            fd = readFd; // kept for the next samples
+            openFds++;
+        }
+    }
+    ssize_t size = pread(readFd, buf, PROC_READ_SIZE - 1, 0);
+    int readErrno = errno;
+    if (fd != readFd) {
+        close(readFd);
+    }
+    if (size == -1) {
+        buf[0] = '\0';
+        return readErrno != ESRCH; // the fd of a reaped process reads ESRCH
+    }
+    buf[size] = '\0';
+    return true;
+}
+
+bool ProcSampler::sample(pid_t pid, ProcSample &out) {
+    auto found = tracked.find(pid);
+    bool first = found == tracked.end();
+    if (first) {
+        Tracked proc = {-1, -1, -1, -1, 0, 0, 0, 0, sweep};
+        found = tracked.insert(std::make_pair(pid, proc)).first;
+    }
+    Tracked &proc = found->second;
+    proc.sweep = sweep;
+    char buf[PROC_READ_SIZE];
+    if (!readProc(proc.statFd, pid, "stat", buf) || buf[0] == '\0') {
+        untrack(proc);
+        tracked.erase(found);
+        return false;
+    }
+    //the fields after the comm, which may have spaces and parentheses
+    const char *fields = strrchr(buf, ')');
+    if (fields == NULL) {
+        return false;
+    }
+    unsigned long long utime = 0, stime = 0, startTicks = 0;
+    if (sscanf(fields + 2, "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+                           "%llu %llu %*d %*d %*d %*d %*d %*d %llu",
+               &out.state, &utime, &stime, &startTicks) != 4) {
+        return false;
+    }
+    long long now = bootNs();
+    if (first) { // the first rates are since the process started
+        proc.sampledNs = startTicks * NS_PER_SEC / ticksPerSec;
+    }
+    double elapsed = (now - proc.sampledNs) / (double) NS_PER_SEC;
+    if (elapsed <= 0) {
+        elapsed = 1.0 / ticksPerSec;
+    }
+    out.cpu = (utime + stime - proc.cpuTicks) * 100.0 / ticksPerSec / elapsed;
+    proc.cpuTicks = utime + stime;
+    out.rssKb = 0;
+    if (readProc(proc.statmFd, pid, "statm", buf)) {
+        char *resident;
+        strtol(buf, &resident, 10); // the size, then the resident pages
+        out.rssKb = strtol(resident, NULL, 10) * pageKb;
+    }
+    out.readKbps = 0;
+    out.writeKbps = 0;
+    if (readProc(proc.ioFd, pid, "io", buf)) { // no access without ptrace
+        const char *readLine = strstr(buf, "\nread_bytes:");
+        const char *writeLine = strstr(buf, "\nwrite_bytes:");
+        if (readLine != NULL && writeLine != NULL) {
+            unsigned long long readBytes = strtoull(readLine + 12, NULL, 10);
+            unsigned long long writeBytes = strtoull(writeLine + 13, NULL, 10);
+            out.readKbps = (readBytes - proc.readBytes) / 1024.0 / elapsed;
+            out.writeKbps = (writeBytes - proc.writeBytes) / 1024.0 / elapsed;
+            proc.readBytes = readBytes;
+            proc.writeBytes = writeBytes;
+        }
+    }
+    proc.sampledNs = now;
+    return true;
+}
+
+void ProcSampler::children(pid_t pid, std::vector<pid_t> &out) {
+    auto found = tracked.find(pid);
+    if (found == tracked.end()) { // sampled first, so it is gone
+        return;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "task/%d/children", (int) pid);
+    char buf[PROC_READ_SIZE];
+    if (!readProc(found->second.childrenFd, pid, name, buf)) {
+        return;
+    }
+    char *next = buf;
+    char *end;
+    long child;
+    //every pid is followed by a space, one cut by the buffer isn't
+    while ((child = strtol(next, &end, 10)) > 0 && *end == ' ') {
+        out.push_back(child);
+        next = end;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef SMASH_PROCSTAT_H_
+#define SMASH_PROCSTAT_H_
+
+#include <vector>
+#include <unordered_map>
+#include <sys/types.h>
+
+#define PROC_READ_SIZE (1024) // /proc/pid/stat, statm and io fit in it
+
+//a process as jtop shows it
+typedef struct {
+    char state; // of /proc/pid/stat: R, S, D, T, Z...
+    double cpu; // % of one cpu
+    long rssKb;
+    double readKbps; // storage i/o, kB per sec
+    double writeKbps;
+} ProcSample;
+
+//samples processes from /proc. the files of a process are opened once
+// and read with pread on every sample, the rates are since its previous
+// sample (since it started on the first). a process that wasn't sampled
+// during a sweep is forgotten and its fds are closed
+class ProcSampler {
+    struct Tracked {
+        int statFd; // -1 until opened
+        int statmFd;
+        int ioFd;
+        int childrenFd; // /proc/pid/task/pid/children
+        unsigned long long cpuTicks; // utime + stime at the last sample
+        unsigned long long readBytes;
+        unsigned long long writeBytes;
+        long long sampledNs; // CLOCK_BOOTTIME, like the start time in stat
+        unsigned long sweep; // the last sweep that sampled it
+    };
+
+    std::unordered_map<pid_t, Tracked> tracked;
+    unsigned long sweep;
+    long ticksPerSec;
+    long pageKb;
+    int openFds;
+    int maxOpenFds; // more files are opened for each read
+
+    //reads the file into buf (NUL terminated), opening it into fd first
+    // if needed. past maxOpenFds it is opened just for the read. false if
+    // the process is gone
+    bool readProc(int &fd, pid_t pid, const char *name, char *buf);
+
+    //closes the fds of the process
+    void untrack(Tracked &proc);
+
+public:
+    ProcSampler();
+
+    ~ProcSampler();
+
+    ProcSampler(const ProcSampler &) = delete;
+
+    void operator=(const ProcSampler &) = delete;
+
+    void beginSweep() {
+        sweep++;
+    }
+
+    //forgets the processes not sampled since beginSweep
+    void endSweep();
+
+    //false if the process is gone
+    bool sample(pid_t pid, ProcSample &out);
+
+    //appends the children of the process, none if the kernel doesn't list
+    // them
+    void children(pid_t pid, std::vector<pid_t> &out);
+};
+
+#endif //SMASH_PROCSTAT_H_
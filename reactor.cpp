@@ -0,0 +1,352 @@
+#include <iostream>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "reactor.h"
+#include "signals.h"
+#include "Commands.h"
+
+using namespace std;
+
+#define MAX_EVENTS (8)
+#define READ_SIZE (65536) // piped scripts are read in large chunks
+
+typedef enum {
+    STDIN_EVENT, SIGNAL_EVENT, TIMER_EVENT, RETRY_EVENT, PIDFD_EVENT
+} EVENT_SOURCE;
+
+static int epollFd = -1;
+static int signalFd = -1;
+static int timerFd = -1;
+static int retryFd = -1; // re-checks the admission of queued jobs
+static long long retryInterval = 0;
+static int inputFd = 0; // stdin, or a script that can't be mapped
+static bool inputPolled = true; // false if it is a file epoll can't watch
+static bool inputReady = false;
+static bool inputEnded = false;
+static string input; // read from inputFd, the lines from inputPos on are
+static size_t inputPos = 0; // not returned yet
+static const char *script = NULL; // lines to run instead of stdin
+static const char *scriptEnd = NULL;
+static bool childEvents = false;
+static bool reaping = false; // the job table is being updated
+static pid_t waitedPid = 0; // of the running reactorWait, 0 if none
+
+//a status of a waited child the job table reaped
+typedef struct {
+    pid_t waiter; // the waitedPid it was reaped during
+    pid_t pid;
+    int status;
+    struct rusage usage;
+} StashedStatus;
+
+static std::vector<StashedStatus> stashed; // oldest first
+static bool interrupted = false; // ctrl-C or ctrl-Z came, for reactorPause
+
+static bool watch(int fd, EVENT_SOURCE source, uint32_t events, int op) {
+    struct epoll_event event;
+    event.events = events;
+    event.data.u32 = source;
+    return epoll_ctl(epollFd, op, fd, &event) == 0;
+}
+
+//the input is only armed while a line is read, so input waiting for the
+// next prompt doesn't wake foreground waits. one shot, so even a hang up
+// is reported once
+static bool watchInput() {
+    inputPolled = true;
+    if (!watch(inputFd, STDIN_EVENT, EPOLLONESHOT, EPOLL_CTL_ADD)) {
+        if (errno != EPERM) {
+            perror("smash error: epoll_ctl failed");
+            return false;
+        }
+        inputPolled = false; // a regular file, reads never block anyway
+    }
+    return true;
+}
+
+bool initReactor() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTSTP);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+        perror("smash error: sigprocmask failed");
+        return false;
+    }
+    signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signalFd == -1) {
+        perror("smash error: signalfd failed");
+        return false;
+    }
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFd == -1) {
+        perror("smash error: timerfd_create failed");
+        return false;
+    }
+    retryFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (retryFd == -1) {
+        perror("smash error: timerfd_create failed");
+        return false;
+    }
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd == -1) {
+        perror("smash error: epoll_create1 failed");
+        return false;
+    }
+    if (!watch(signalFd, SIGNAL_EVENT, EPOLLIN, EPOLL_CTL_ADD) ||
+        !watch(timerFd, TIMER_EVENT, EPOLLIN, EPOLL_CTL_ADD) ||
+        !watch(retryFd, RETRY_EVENT, EPOLLIN, EPOLL_CTL_ADD)) {
+        perror("smash error: epoll_ctl failed");
+        return false;
+    }
+    return watchInput();
+}
+
+//reaps the finished jobs and admits the queued ones the policy allows now,
+// also while a foreground cmd is waited for
+static void updateJobs() {
+    if (reaping) { // from a cmd the update started, it runs on afterwards
+        return;
+    }
+    reaping = true;
+    SmallShell::getInstance().reapJobs();
+    reaping = false;
+}
+
+static void handleSignals() {
+    struct signalfd_siginfo info;
+    while (read(signalFd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGINT) {
+            interrupted = true;
+            ctrlCHandler(SIGINT);
+        } else if (info.ssi_signo == SIGTSTP) {
+            interrupted = true;
+            ctrlZHandler(SIGTSTP);
+        } else if (info.ssi_signo == SIGCHLD) {
+            childEvents = true;
+        }
+    }
+    if (childEvents) {
+        updateJobs();
+    }
+}
+
+static void handleTimer() {
+    uint64_t expirations;
+    if (read(timerFd, &expirations, sizeof(expirations)) ==
+        sizeof(expirations)) {
+        alarmHandler(SIGALRM);
+    }
+}
+
+//waits up to timeout ms (-1 for ever) for the next events and handles them
+static void runOnce(int timeout) {
+    struct epoll_event events[MAX_EVENTS];
+    int ready = epoll_wait(epollFd, events, MAX_EVENTS, timeout);
+    if (ready == -1) {
+        if (errno != EINTR) {
+            perror("smash error: epoll_wait failed");
+        }
+        return;
+    }
+    for (int i = 0; i < ready; i++) {
+        switch (events[i].data.u32) {
+            case STDIN_EVENT:
+                inputReady = true;
+                break;
+            case SIGNAL_EVENT:
+                handleSignals();
+                break;
+            case TIMER_EVENT:
+                handleTimer();
+                break;
+            case RETRY_EVENT: { // the pressure may have dropped
+                uint64_t expirations;
+                if (read(retryFd, &expirations, sizeof(expirations)) ==
+                    sizeof(expirations)) {
+                    updateJobs();
+                }
+                break;
+            }
+            default: // a pidfd, the waiter checks its process
+                break;
+        }
+    }
+}
+
+bool reactorSetInput(int fd) {
+    if (inputPolled) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, inputFd, NULL);
+    }
+    inputFd = fd;
+    return watchInput();
+}
+
+void reactorSetScript(const char *data, size_t size) {
+    script = data;
+    scriptEnd = data + size;
+    if (size >= 2 && data[0] == '#' && data[1] == '!') { // the interpreter line
+        const char *newline = (const char *) memchr(data, '\n', size);
+        script = newline == NULL ? scriptEnd : newline + 1;
+    }
+}
+
+//the next line of the script. the events that came meanwhile are handled
+// first, as they would be while waiting at the prompt
+static bool readScriptLine(string &line) {
+    runOnce(0);
+    if (script == scriptEnd) {
+        return false;
+    }
+    const char *newline = (const char *) memchr(script, '\n',
+                                                scriptEnd - script);
+    const char *end = newline == NULL ? scriptEnd : newline;
+    line.assign(script, end - script);
+    script = newline == NULL ? scriptEnd : newline + 1;
+    return true;
+}
+
+bool reactorReadLine(string &line) {
+    if (script != NULL) {
+        return readScriptLine(line);
+    }
+    while (true) {
+        size_t newline = input.find('\n', inputPos);
+        if (newline != string::npos) {
+            line.assign(input, inputPos, newline - inputPos);
+            inputPos = newline + 1;
+            return true;
+        }
+        if (inputEnded) {
+            line.assign(input, inputPos, string::npos);
+            input.clear();
+            inputPos = 0;
+            return !line.empty();
+        }
+        if (inputPolled && !inputReady) {
+            cout.flush(); // the prompt, or the output of the lines so far
+            watch(inputFd, STDIN_EVENT, EPOLLIN | EPOLLONESHOT, EPOLL_CTL_MOD);
+            runOnce(-1);
+            continue;
+        }
+        inputReady = false;
+        input.erase(0, inputPos); // the returned lines
+        inputPos = 0;
+        size_t used = input.size();
+        input.resize(used + READ_SIZE);
+        ssize_t readSize = read(inputFd, &input[used], READ_SIZE);
+        input.resize(used + (readSize > 0 ? readSize : 0));
+        if (readSize == -1 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        }
+        if (readSize == -1) {
+            perror("smash error: read failed");
+        }
+        if (readSize <= 0) {
+            inputEnded = true;
+            continue;
+        }
+    }
+}
+
+pid_t reactorWait(pid_t pid, int *status, int options, struct rusage *usage) {
+    int pidFd = pid > 0 ? syscall(SYS_pidfd_open, pid, 0) : -1;
+    if (pidFd != -1) { // wakes up on exit even if SIGCHLD was coalesced
+        watch(pidFd, PIDFD_EVENT, EPOLLIN, EPOLL_CTL_ADD);
+    }
+    pid_t outerPid = waitedPid; // a wait from a cmd the loop started
+    waitedPid = pid;
+    struct rusage used;
+    pid_t res;
+    //the job table reaps every child, so the statuses of this one may be
+    // stashed already
+    while ((res = takeStashed(pid, options, status, &used)) == 0 &&
+           (res = wait4(pid, status, options | WNOHANG, &used)) == 0) {
+        runOnce(-1);
+    }
+    if (res > 0 && usage != NULL) {
+        *usage = used;
+    }
+    waitedPid = outerPid;
+    if (pidFd != -1) {
+        close(pidFd); // also removes it from the epoll
+    }
+    return res;
+}
+
+pid_t waitedChild() {
+    return waitedPid;
+}
+
+void stashWaited(pid_t pid, int status, const struct rusage &usage) {
+    StashedStatus entry = {waitedPid, pid, status, usage};
+    stashed.push_back(entry);
+}
+
+pid_t takeStashed(pid_t waiter, int options, int *status,
+                  struct rusage *usage) {
+    for (unsigned int i = 0; i < stashed.size(); i++) {
+        if (stashed[i].waiter != waiter && stashed[i].pid != waiter) {
+            continue;
+        }
+        StashedStatus entry = stashed[i];
+        stashed.erase(stashed.begin() + i);
+        if ((WIFSTOPPED(entry.status) && !(options & WUNTRACED)) ||
+            (WIFCONTINUED(entry.status) && !(options & WCONTINUED))) {
+            i--; // not a status the waiter asked for
+            continue;
+        }
+        *status = entry.status;
+        *usage = entry.usage;
+        return entry.pid;
+    }
+    return 0;
+}
+
+bool reactorPause(long long ns) {
+    interrupted = false;
+    long long until = monotonicNs() + ns;
+    long long left;
+    while (!interrupted && (left = until - monotonicNs()) > 0) {
+        runOnce((left + 999999) / 1000000); // rounded up to whole ms
+    }
+    return !interrupted;
+}
+
+void armTimer(long long deadline) {
+    struct itimerspec timer = {{0, 0}, {(time_t) (deadline / NS_PER_SEC),
+                                        (long) (deadline % NS_PER_SEC)}};
+    if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &timer, NULL) == -1) {
+        perror("smash error: timerfd_settime failed");
+    }
+}
+
+bool takeChildEvents() {
+    bool changed = childEvents;
+    childEvents = false;
+    return changed;
+}
+
+void armRetry(long long interval) {
+    if (interval == retryInterval) {
+        return;
+    }
+    retryInterval = interval;
+    struct timespec period = {(time_t) (interval / NS_PER_SEC),
+                              (long) (interval % NS_PER_SEC)};
+    struct itimerspec timer = {period, period};
+    if (timerfd_settime(retryFd, 0, &timer, NULL) == -1) {
+        perror("smash error: timerfd_settime failed");
+    }
+}
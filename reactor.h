@@ -0,0 +1,65 @@
+#ifndef SMASH_REACTOR_H_
+#define SMASH_REACTOR_H_
+
+#include <string>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+//smash runs as one epoll loop. it watches stdin, a signalfd for ctrl-C,
+// ctrl-Z and SIGCHLD, the timerfd of the timeouts and the pidfd of the
+// foreground process. those signals are blocked, so their handlers run
+// from the loop and never interrupt smash
+
+//blocks the signals and creates the fds, false on failure (printed)
+bool initReactor();
+
+//runs the loop until a whole line was read from stdin, false at the end
+// of the input. the output is flushed only before waiting for more input.
+// finished jobs are reaped as soon as SIGCHLD comes, by any wait of the
+// loop
+bool reactorReadLine(std::string &line);
+
+//reactorReadLine reads the lines from fd instead of stdin, false on
+// failure (printed)
+bool reactorSetInput(int fd);
+
+//reactorReadLine returns the lines of data (a -c cmd or a mapped script)
+// instead of reading stdin. a first #! line is skipped. data must outlive
+// the reading
+void reactorSetScript(const char *data, size_t size);
+
+//wait4 that keeps the loop running while it waits, so ctrl-C, ctrl-Z
+// and timeouts are handled meanwhile. usage may be NULL
+pid_t reactorWait(pid_t pid, int *status, int options, struct rusage *usage);
+
+//runs the loop for ns, false if it stopped early because of ctrl-C or
+// ctrl-Z
+bool reactorPause(long long ns);
+
+//arms the timeout timer to expire at deadline (CLOCK_MONOTONIC ns), 0
+// disarms it
+void armTimer(long long deadline);
+
+//wakes the loop every interval ns to admit queued jobs again, 0 stops
+void armRetry(long long interval);
+
+//returns true if a child changed state since the last call
+bool takeChildEvents();
+
+//the pid (or -pgid) reactorWait waits for, 0 if none. the job table
+// stashes the statuses of its processes for the wait
+pid_t waitedChild();
+
+//keeps a status the job table reaped for a process of the waited cmd
+void stashWaited(pid_t pid, int status, const struct rusage &usage);
+
+//takes the oldest stashed status of pid, or of a process reaped while
+// waiter (a pid or -pgid) was waited for. the kinds of status options
+// doesn't ask for (WUNTRACED, WCONTINUED) are dropped. returns the pid,
+// or 0 if none is stashed
+pid_t takeStashed(pid_t waiter, int options, int *status,
+                  struct rusage *usage);
+
+#endif //SMASH_REACTOR_H_
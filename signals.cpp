@@ -9,7 +9,6 @@ using namespace std;
 
 bool sigSTPOn = false;
 bool sigINTOn = false;
-bool sigAlarmOn = false;
 
 void ctrlCHandler(int sig_num) {
     cout << "smash: got ctrl-C" << endl;
@@ -20,7 +19,7 @@ void ctrlCHandler(int sig_num) {
     if (isForegroundTimeout) {
         kill(foregroundPid, SIGINT);
     } else if (isForegroundPipe) {
-        kill(foregroundPid, SIGINT);
+        kill(-foregroundPid, SIGKILL);
     } else {
         kill(foregroundPid, SIGKILL);
     }
@@ -36,53 +35,16 @@ void ctrlZHandler(int sig_num) {
     if (isForegroundTimeout) {
         kill(foregroundPid, SIGTSTP);
     } else if (isForegroundPipe) {
-        kill(foregroundPid, SIGTSTP);
+        kill(-foregroundPid, SIGSTOP);
     } else {
         kill(foregroundPid, SIGSTOP);
     }
     cout << "smash: process " << foregroundPid << " was stopped" << endl;
 }
 
-void pipeCtrlCHandler(int sig_num) {
-    sigINTOn = true; //pay attention, this is copy of the global sigSTPOn of the smash process, it's the same one!!
-    if (pipeFirstCmdPid != NOT_FORKED) {
-        kill(pipeFirstCmdPid, SIGKILL);
-    }
-    if (pipeSecondCmdPid != NOT_FORKED) {
-        kill(pipeSecondCmdPid, SIGKILL);
-    }
-}
-
-void pipeCtrlZHandler(int sig_num) {
-    if (pipeFirstCmdPid != NOT_FORKED) {
-        kill(pipeFirstCmdPid, SIGSTOP);
-    }
-    if (pipeSecondCmdPid != NOT_FORKED) {
-        kill(pipeSecondCmdPid, SIGSTOP);
-    }
-    kill(getpid(), SIGSTOP);
-}
-
-void pipeSigcontHandler(int sig_num) {
-    if (pipeFirstCmdPid != NOT_FORKED) {
-        kill(pipeFirstCmdPid, SIGCONT);
-    }
-    if (pipeSecondCmdPid != NOT_FORKED) {
-        kill(pipeSecondCmdPid, SIGCONT);
-    }
-
-    /*after this, pipe should restart the waitpid in the pipe execute
-     * to wait for his sons that have been already continued until they finish
-     * or until the next signal interrupt*/
-}
-
 void alarmHandler(int sig_num) {
-    sigAlarmOn = true;
     cout << "smash: got an alarm" << endl;
-    kill(nextAlarmedPid, SIGINT); //sending SIGINT so Timeout cmd will kill it's inner cmd and commit suicide
-    pid_t lastTimeout = nextAlarmedPid;
-    removeTimeoutAndSetNewAlarm(nextAlarmedPid);
-    kill(lastTimeout, SIGCONT);
+    expireTimeouts();
 }
 
 void timeoutCtrlCHandler(int sig_num) {
@@ -1,18 +1,15 @@
 #ifndef SMASH__SIGNALS_H_
 #define SMASH__SIGNALS_H_
 
+//smash's handlers are called from its event loop, see reactor.h. the
+// timeout ones are real handlers of the timeout process
+
 void ctrlZHandler(int sig_num);
 
 void ctrlCHandler(int sig_num);
 
 void alarmHandler(int sig_num);
 
-void pipeCtrlCHandler(int sig_num);
-
-void pipeCtrlZHandler(int sig_num);
-
-void pipeSigcontHandler(int sig_num);
-
 void timeoutCtrlCHandler(int sig_num);
 
 void timeoutCtrlZHandler(int sig_num);
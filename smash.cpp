@@ -1,27 +1,100 @@
 #include <iostream>
 #include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <signal.h>
 #include "Commands.h"
-#include "signals.h"
+#include "reactor.h"
+#include "status.h"
 
+//maps the script so its lines are read without copying it, a script that
+// isn't a regular file is read like stdin. false on failure (printed)
+static bool mapScript(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        perror("smash error: open failed");
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1) {
+        perror("smash error: fstat failed");
+        close(fd);
+        return false;
+    }
+    if (!S_ISREG(info.st_mode)) { // a pipe or a fifo, read in chunks instead
+        return reactorSetInput(fd);
+    }
+    if (info.st_size == 0) { // mmap doesn't take an empty mapping
+        close(fd);
+        reactorSetScript("", 0);
+        return true;
+    }
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("smash error: mmap failed");
+        return false;
+    }
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+    reactorSetScript((const char *) data, info.st_size); // mapped until exit
+    return true;
+}
+
+static int usage() {
+    std::cerr << "smash error: usage: smash [-e] [-c cmd | script]"
+              << std::endl;
+    return 2;
+}
+
+//smash [-e] [-c cmd | script], without a cmd or a script the lines are
+// read from stdin after a prompt. -e stops at the first cmd that failed
 int main(int argc, char* argv[]) {
-    if (signal(SIGTSTP, ctrlZHandler) == SIG_ERR) {
-        perror("smash error: failed to set ctrl-Z handler");
+    bool stopOnError = false;
+    const char *cmd = NULL;
+    const char *scriptPath = NULL;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-e") == 0) {
+            stopOnError = true;
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            cmd = argv[++i];
+        } else {
+            return usage();
+        }
+    }
+    if (i < argc && cmd == NULL) {
+        scriptPath = argv[i++];
+    }
+    if (i < argc) {
+        return usage();
     }
-    if (signal(SIGINT, ctrlCHandler) == SIG_ERR) {
-        perror("smash error: failed to set ctrl-C handler");
+    if (!initReactor()) {
+        return 1;
     }
-    if (signal(SIGALRM, alarmHandler) == SIG_ERR) {
-        perror("smash error: failed to set alarm handler");
+    if (cmd != NULL) {
+        reactorSetScript(cmd, strlen(cmd));
+    } else if (scriptPath != NULL && !mapScript(scriptPath)) {
+        return 1;
     }
+    bool interactive = cmd == NULL && scriptPath == NULL;
+    bool prompt = interactive && isatty(0); // not for piped lines
 
     SmallShell &smash = SmallShell::getInstance();
     while (!(smash.getToQuit())) {
-        std::cout << smash.getPrompt() << "> ";
+        if (prompt) {
+            std::cout << smash.getPrompt() << "> " << std::flush;
+        }
         std::string cmd_line;
-        std::getline(std::cin, cmd_line);
+        if (!reactorReadLine(cmd_line)) { // end of the input
+            break;
+        }
         smash.executeCommand(cmd_line.c_str());
+        if (stopOnError && lastExitStatus != 0) {
+            break;
+        }
     }
-    return 0;
-}
\ No newline at end of file
+    return interactive ? 0 : lastExitStatus;
+}
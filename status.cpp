@@ -0,0 +1,36 @@
+#include <sys/wait.h>
+#include "status.h"
+
+int exitCode(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    } else if (WIFSTOPPED(status)) {
+        return 128 + WSTOPSIG(status);
+    }
+    return 0;
+}
+
+static void addTime(struct timeval &total, const struct timeval &more) {
+    total.tv_sec += more.tv_sec;
+    total.tv_usec += more.tv_usec;
+    if (total.tv_usec >= 1000000) {
+        total.tv_sec++;
+        total.tv_usec -= 1000000;
+    }
+}
+
+void addUsage(struct rusage &total, const struct rusage &more) {
+    addTime(total.ru_utime, more.ru_utime);
+    addTime(total.ru_stime, more.ru_stime);
+    if (more.ru_maxrss > total.ru_maxrss) { // stages ran side by side
+        total.ru_maxrss = more.ru_maxrss;
+    }
+    total.ru_minflt += more.ru_minflt;
+    total.ru_majflt += more.ru_majflt;
+    total.ru_inblock += more.ru_inblock;
+    total.ru_oublock += more.ru_oublock;
+    total.ru_nvcsw += more.ru_nvcsw;
+    total.ru_nivcsw += more.ru_nivcsw;
+}
@@ -0,0 +1,14 @@
+#ifndef SMASH_STATUS_H_
+#define SMASH_STATUS_H_
+
+#include <sys/resource.h>
+
+//the shell exit code of a waitpid status: the exit status, or 128 plus
+// the signal that killed or stopped the process
+int exitCode(int status);
+
+//adds the usage of more to total: the times and counters add up, the max
+// rss is the larger one
+void addUsage(struct rusage &total, const struct rusage &more);
+
+#endif //SMASH_STATUS_H_
@@ -0,0 +1,84 @@
+#include <time.h>
+#include "timers.h"
+
+long long monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+void TimerQueue::place(size_t index, const Timer &timer) {
+    heap[index] = timer;
+    indexByPid[timer.pid] = index;
+}
+
+void TimerQueue::siftUp(size_t index) {
+    Timer timer = heap[index];
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (heap[parent].due <= timer.due) {
+            break;
+        }
+        place(index, heap[parent]);
+        index = parent;
+    }
+    place(index, timer);
+}
+
+void TimerQueue::siftDown(size_t index) {
+    Timer timer = heap[index];
+    size_t size = heap.size();
+    while (2 * index + 1 < size) {
+        size_t child = 2 * index + 1;
+        if (child + 1 < size && heap[child + 1].due < heap[child].due) {
+            child++;
+        }
+        if (timer.due <= heap[child].due) {
+            break;
+        }
+        place(index, heap[child]);
+        index = child;
+    }
+    place(index, timer);
+}
+
+void TimerQueue::removeAt(size_t index) {
+    indexByPid.erase(heap[index].pid);
+    Timer last = heap.back();
+    heap.pop_back();
+    if (index == heap.size()) {
+        return;
+    }
+    //the last timer takes the hole and moves whichever way it belongs
+    heap[index] = last;
+    if (index > 0 && last.due < heap[(index - 1) / 2].due) {
+        siftUp(index);
+    } else {
+        siftDown(index);
+    }
+}
+
+void TimerQueue::add(pid_t pid, long long deadline, Command *cmd) {
+    cancel(pid); // a reused pid replaces its stale timer
+    long long due = (deadline + TIMER_TICK_NS - 1) / TIMER_TICK_NS *
+                    TIMER_TICK_NS;
+    Timer timer = {deadline, due, pid, cmd};
+    heap.push_back(timer);
+    siftUp(heap.size() - 1);
+}
+
+bool TimerQueue::cancel(pid_t pid) {
+    auto found = indexByPid.find(pid);
+    if (found == indexByPid.end()) {
+        return false;
+    }
+    removeAt(found->second);
+    return true;
+}
+
+void TimerQueue::popDue(long long now, std::vector<Timer> &due) {
+    while (!heap.empty() && heap[0].due <= now) {
+        due.push_back(heap[0]);
+        removeAt(0);
+    }
+}
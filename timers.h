@@ -0,0 +1,63 @@
+#ifndef SMASH_TIMERS_H_
+#define SMASH_TIMERS_H_
+
+#include <vector>
+#include <unordered_map>
+#include <sys/types.h>
+
+#define NS_PER_SEC (1000000000LL)
+#define TIMER_TICK_NS (1000000LL) // deadlines are rounded up to ticks
+
+class Command;
+
+//a pending timeout, pid is the timeout process to signal at deadline
+typedef struct {
+    long long deadline; // CLOCK_MONOTONIC ns
+    long long due; // deadline rounded up to a tick, the heap order
+    pid_t pid;
+    Command *cmd;
+} Timer;
+
+//CLOCK_MONOTONIC in ns
+long long monotonicNs();
+
+//min-heap of the timers by deadline, indexed by pid so a timer can be
+// cancelled when its cmd finishes first. add and cancel are O(log n).
+// timers of the same tick share a deadline, so they expire together
+class TimerQueue {
+    std::vector<Timer> heap;
+    std::unordered_map<pid_t, size_t> indexByPid;
+
+    void place(size_t index, const Timer &timer);
+
+    void siftUp(size_t index);
+
+    void siftDown(size_t index);
+
+    void removeAt(size_t index);
+
+public:
+    TimerQueue() : heap(), indexByPid() {
+    };
+
+    ~TimerQueue() = default;
+
+    void add(pid_t pid, long long deadline, Command *cmd);
+
+    //false if pid has no timer
+    bool cancel(pid_t pid);
+
+    //moves all the timers due by now to due, earliest first
+    void popDue(long long now, std::vector<Timer> &due);
+
+    //when the earliest timer is due, 0 if there are no timers
+    long long nextDeadline() const {
+        return heap.empty() ? 0 : heap[0].due;
+    }
+
+    size_t size() const {
+        return heap.size();
+    }
+};
+
+#endif //SMASH_TIMERS_H_
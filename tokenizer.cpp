@@ -0,0 +1,129 @@
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "tokenizer.h"
+
+using std::string;
+
+//the same chars istringstream splits words at
+static bool isSpace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static bool isSpecial(char c) {
+    return isSpace(c) || c == '>' || c == '|' || c == '&';
+}
+
+size_t findSpecial(const char *str, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i belowTab = _mm_set1_epi8('\t' - 1);
+    const __m128i aboveCr = _mm_set1_epi8('\r' + 1);
+    const __m128i redirect = _mm_set1_epi8('>');
+    const __m128i pipe = _mm_set1_epi8('|');
+    const __m128i amper = _mm_set1_epi8('&');
+    for (; i + 16 <= n; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *) (str + i));
+        //'\t' to '\r' is a range, bytes above 127 are negative and outside
+        __m128i special = _mm_and_si128(_mm_cmpgt_epi8(chunk, belowTab),
+                                        _mm_cmplt_epi8(chunk, aboveCr));
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, space));
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, redirect));
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, pipe));
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, amper));
+        int mask = _mm_movemask_epi8(special);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (isSpecial(str[i])) {
+            return i;
+        }
+    }
+    return n;
+}
+
+ParsedLine::ParsedLine(const char *line) : arena(), argv(), argsNum(0),
+                                           background(false), redirect(false),
+                                           append(false), pipe(false),
+                                           pipeErr(false) {
+    size_t length = strlen(line);
+    size_t end = length;
+    while (end > 0 && isSpace(line[end - 1])) {
+        end--;
+    }
+    if (end > 0 && line[end - 1] == '&') {
+        background = true;
+        end--;
+    }
+    //a word split at '>' takes at most 2 NULs per char, so the arena never
+    // grows and the pointers into it stay valid
+    arena.resize(2 * end + 1);
+    //an arg takes 2 chars with its separator, only '>' args glued together
+    // take less and may grow argv
+    argv.reserve(end / 2 + 1 + ARGS_PADDING);
+    char *out = arena.data();
+    char *word = NULL; // the arg being written
+    size_t i = 0;
+    while (i < length) {
+        size_t next = i + findSpecial(line + i, length - i);
+        size_t copyEnd = next < end ? next : end;
+        if (copyEnd > i) {
+            if (word == NULL) {
+                word = out;
+            }
+            memcpy(out, line + i, copyEnd - i);
+            out += copyEnd - i;
+        }
+        if (next == length) {
+            break;
+        }
+        char c = line[next];
+        i = next + 1;
+        if (c == '|') {
+            pipe = true;
+            if (i < length && line[i] == '&') {
+                pipeErr = true;
+            }
+        } else if (c == '>') {
+            redirect = true;
+            if (i < length && line[i] == '>') {
+                append = true;
+            }
+        }
+        if (next >= end) {
+            continue; // only the flags are wanted past the end
+        }
+        if (c == '|' || c == '&') { // part of the word
+            if (word == NULL) {
+                word = out;
+            }
+            *out++ = c;
+            continue;
+        }
+        if (word != NULL) { // whitespace or '>' ends the word
+            *out++ = '\0';
+            argv.push_back(word);
+            word = NULL;
+        }
+        if (c == '>') {
+            argv.push_back(out);
+            *out++ = '>';
+            if (i < end && line[i] == '>') {
+                *out++ = '>';
+                i++;
+            }
+            *out++ = '\0';
+        }
+    }
+    if (word != NULL) {
+        *out = '\0';
+        argv.push_back(word);
+    }
+    argsNum = argv.size();
+    argv.insert(argv.end(), ARGS_PADDING, (char *) NULL);
+}
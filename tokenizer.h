@@ -0,0 +1,67 @@
+#ifndef SMASH_TOKENIZER_H_
+#define SMASH_TOKENIZER_H_
+
+#include <vector>
+#include <string>
+#include <stddef.h>
+
+#define ARGS_PADDING (3) // NULLs after the last arg, args[argsNum + 2] is safe
+
+//the offset of the first whitespace, '>', '|' or '&' in the n chars at
+// str, n if there is none. scans 16 chars at a time with SSE2
+size_t findSpecial(const char *str, size_t n);
+
+//a cmd line split to its args in one pass. the args are written NUL
+// terminated into one arena sized for the line up front, so there is no
+// limit on the line length or the number of args. '>' and '>>' are args
+// of their own even when glued to a word, and a trailing '&' is dropped
+class ParsedLine {
+    std::vector<char> arena;
+    std::vector<char *> argv; // into arena, then ARGS_PADDING NULLs
+    int argsNum;
+    bool background;
+    bool redirect; // the line has '>' ...
+    bool append; // ... '>>'
+    bool pipe; // ... '|'
+    bool pipeErr; // ... '|&'
+
+public:
+    explicit ParsedLine(const char *line);
+
+    ~ParsedLine() = default;
+
+    ParsedLine(const ParsedLine &) = delete; // argv points into arena
+    void operator=(const ParsedLine &) = delete;
+
+    ParsedLine(ParsedLine &&) = default; // moves the arena, argv stays valid
+
+    char **getArgs() {
+        return argv.data();
+    }
+
+    int getArgsNum() const {
+        return argsNum;
+    }
+
+    bool isBackground() const {
+        return background;
+    }
+
+    bool hasRedirect() const {
+        return redirect;
+    }
+
+    bool hasAppend() const {
+        return append;
+    }
+
+    bool hasPipe() const {
+        return pipe;
+    }
+
+    bool hasPipeErr() const {
+        return pipeErr;
+    }
+};
+
+#endif //SMASH_TOKENIZER_H_